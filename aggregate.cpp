@@ -0,0 +1,406 @@
+#include "aggregate.h"
+#include "hash_table.h"
+#include "index.h"
+#include "parallel_sort.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <type_traits>
+
+namespace {
+
+// Sum, minimum or maximum of the batch's values, folded into the running ones.
+// Dense batches read a contiguous slice of the column, which the compiler
+// turns into vector instructions.
+template <typename T, typename Sum>
+void foldNumbers(const std::vector<T>& values, const Batch& batch, AggregateFunction function, bool first,
+                 Sum& sum, T& min, T& max) {
+    const T* base = values.data();
+    size_t count = batch.count;
+    switch (function) {
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG: {
+            Sum total = 0;
+            if (batch.dense) {
+                const T* slice = base + batch.first;
+                for (size_t i = 0; i < count; ++i) total += slice[i];
+            } else {
+                for (size_t i = 0; i < count; ++i) total += base[batch.rows[i]];
+            }
+            sum += total;
+            break;
+        }
+        case AggregateFunction::MIN: {
+            T best = first ? base[batch.row(0)] : min;
+            if (batch.dense) {
+                const T* slice = base + batch.first;
+                for (size_t i = 0; i < count; ++i) best = std::min(best, slice[i]);
+            } else {
+                for (size_t i = 0; i < count; ++i) best = std::min(best, base[batch.rows[i]]);
+            }
+            min = best;
+            break;
+        }
+        case AggregateFunction::MAX: {
+            T best = first ? base[batch.row(0)] : max;
+            if (batch.dense) {
+                const T* slice = base + batch.first;
+                for (size_t i = 0; i < count; ++i) best = std::max(best, slice[i]);
+            } else {
+                for (size_t i = 0; i < count; ++i) best = std::max(best, base[batch.rows[i]]);
+            }
+            max = best;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+template <typename T, typename Sum>
+void foldValue(const T& value, AggregateFunction function, bool first, Sum& sum, T& min, T& max) {
+    switch (function) {
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG:
+            if constexpr (std::is_arithmetic<T>::value) sum += value;
+            break;
+        case AggregateFunction::MIN:
+            if (first || value < min) min = value;
+            break;
+        case AggregateFunction::MAX:
+            if (first || max < value) max = value;
+            break;
+        default:
+            break;
+    }
+}
+
+// Strings are compared in place and only the winner of the batch is copied
+void foldTexts(const std::vector<std::string>& values, const Batch& batch, AggregateFunction function, bool first,
+               std::string& min, std::string& max) {
+    const std::string* best = &values[batch.row(0)];
+    for (size_t i = 1; i < batch.count; ++i) {
+        const std::string& value = values[batch.row(i)];
+        if (function == AggregateFunction::MIN ? value < *best : *best < value) best = &value;
+    }
+    if (function == AggregateFunction::MIN) {
+        if (first || *best < min) min = *best;
+    } else if (function == AggregateFunction::MAX) {
+        if (first || max < *best) max = *best;
+    }
+}
+
+// Folds each row of the batch into the state of its group: states[groups[i] * stride]
+template <typename T, typename Sum>
+void foldGrouped(const std::vector<T>& values, const Batch& batch, const uint32_t* groups, Accumulator* states,
+                 size_t stride, AggregateFunction function, Sum Accumulator::*sum, T Accumulator::*min, T Accumulator::*max) {
+    for (size_t i = 0; i < batch.count; ++i) {
+        Accumulator& state = states[groups[i] * stride];
+        foldValue(values[batch.row(i)], function, state.count == 0, state.*sum, state.*min, state.*max);
+        ++state.count;
+    }
+}
+
+void addGrouped(const AggregateSpec& spec, const std::vector<Column>& data, const Batch& batch, const uint32_t* groups,
+                Accumulator* states, size_t stride) {
+    if (spec.function == AggregateFunction::COUNT) {
+        for (size_t i = 0; i < batch.count; ++i) ++states[groups[i] * stride].count;
+        return;
+    }
+    const Column& column = data[spec.column];
+    switch (column.type()) {
+        case INT:
+            foldGrouped(column.ints(), batch, groups, states, stride, spec.function,
+                        &Accumulator::intSum, &Accumulator::intMin, &Accumulator::intMax);
+            break;
+        case REAL:
+            foldGrouped(column.reals(), batch, groups, states, stride, spec.function,
+                        &Accumulator::realSum, &Accumulator::realMin, &Accumulator::realMax);
+            break;
+        default:
+            foldGrouped(column.texts(), batch, groups, states, stride, spec.function,
+                        &Accumulator::intSum, &Accumulator::textMin, &Accumulator::textMax);
+            break;
+    }
+}
+
+// Open-addressing table from group keys to group numbers. Groups are stored
+// densely in the order they were first seen: key, hash, a row holding the key
+// and specCount aggregate states each. Slots hold group number + 1, 0 when free.
+template <typename K>
+class GroupTable {
+public:
+    explicit GroupTable(size_t stateCount) : specCount(stateCount), slots(16, 0) {}
+
+    size_t size() const { return keys.size(); }
+
+    uint32_t find(const K& key, uint64_t hash, RowId row) {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            uint32_t slot = slots[i];
+            if (slot == 0) {
+                slots[i] = static_cast<uint32_t>(keys.size() + 1);
+                keys.push_back(key);
+                hashes.push_back(hash);
+                keyRows.push_back(row);
+                states.resize(states.size() + specCount);
+                if (keys.size() * 2 > slots.size()) grow();
+                return static_cast<uint32_t>(keys.size() - 1);
+            }
+            if (hashes[slot - 1] == hash && keys[slot - 1] == key) return slot - 1;
+        }
+    }
+
+    std::vector<K> keys;
+    std::vector<uint64_t> hashes;
+    std::vector<RowId> keyRows;
+    std::vector<Accumulator> states;
+
+private:
+    size_t specCount;
+    std::vector<uint32_t> slots;
+
+    void grow() {
+        slots.assign(slots.size() * 2, 0);
+        size_t mask = slots.size() - 1;
+        for (size_t g = 0; g < keys.size(); ++g) {
+            size_t i = hashes[g] & mask;
+            while (slots[i] != 0) i = (i + 1) & mask;
+            slots[i] = static_cast<uint32_t>(g + 1);
+        }
+    }
+};
+
+// Groups are merged in this many partitions, chosen by the top bits of the
+// key hash (the tables index slots with the low bits)
+constexpr size_t MERGE_PARTITIONS = 64;
+constexpr int PARTITION_SHIFT = 58;
+
+// Runs consume over every batch of source: morsel by morsel in parallel for a
+// ParallelScan, otherwise as part 0 on the calling thread
+void forEachPart(BatchSource& source, const std::function<void(size_t, const Batch&)>& consume) {
+    if (auto* parallel = dynamic_cast<ParallelScan*>(&source)) {
+        parallel->forEachBatch(consume);
+        return;
+    }
+    Batch batch;
+    while (source.next(batch)) consume(0, batch);
+}
+
+// Each part pre-aggregates into its own table. The groups of every table are
+// then bucketed by partition, and each partition merges its buckets, in part
+// order, on its own thread.
+template <typename K, typename KeyAt>
+GroupedResult hashGroups(const std::vector<Column>& data, const std::vector<AggregateSpec>& specs, BatchSource& source,
+                         size_t parts, size_t threads, KeyAt keyAt) {
+    size_t stride = specs.size();
+    std::vector<GroupTable<K>> locals(parts, GroupTable<K>(stride));
+    forEachPart(source, [&](size_t part, const Batch& batch) {
+        GroupTable<K>& table = locals[part];
+        uint32_t groups[BATCH_SIZE];
+        for (size_t i = 0; i < batch.count; ++i) {
+            RowId row = batch.row(i);
+            K key = keyAt(row);
+            groups[i] = table.find(key, hashKey(key), row);
+        }
+        for (size_t s = 0; s < specs.size(); ++s) {
+            addGrouped(specs[s], data, batch, groups, table.states.data() + s, stride);
+        }
+    });
+
+    ThreadPool& pool = ThreadPool::shared();
+    std::vector<std::vector<std::vector<uint32_t>>> buckets(parts, std::vector<std::vector<uint32_t>>(MERGE_PARTITIONS));
+    pool.parallelFor(parts, [&](size_t part) {
+        const GroupTable<K>& table = locals[part];
+        for (size_t g = 0; g < table.size(); ++g) {
+            buckets[part][table.hashes[g] >> PARTITION_SHIFT].push_back(static_cast<uint32_t>(g));
+        }
+    }, threads);
+    std::vector<GroupTable<K>> merged(MERGE_PARTITIONS, GroupTable<K>(stride));
+    pool.parallelFor(MERGE_PARTITIONS, [&](size_t p) {
+        GroupTable<K>& target = merged[p];
+        for (size_t part = 0; part < parts; ++part) {
+            const GroupTable<K>& table = locals[part];
+            for (uint32_t g : buckets[part][p]) {
+                uint32_t into = target.find(table.keys[g], table.hashes[g], table.keyRows[g]);
+                for (size_t s = 0; s < stride; ++s) {
+                    target.states[into * stride + s].merge(specs[s], table.states[g * stride + s]);
+                }
+            }
+        }
+    }, threads);
+
+    GroupedResult result;
+    for (auto& partition : merged) {
+        result.keyRows.insert(result.keyRows.end(), partition.keyRows.begin(), partition.keyRows.end());
+        result.states.insert(result.states.end(), std::make_move_iterator(partition.states.begin()),
+                             std::make_move_iterator(partition.states.end()));
+    }
+    return result;
+}
+
+// Every qualifying row is paired with its key, the pairs are sorted, and each
+// run of equal keys becomes one group
+template <typename K, typename KeyAt>
+GroupedResult sortGroups(const std::vector<Column>& data, const std::vector<AggregateSpec>& specs, BatchSource& source,
+                         size_t parts, size_t threads, KeyAt keyAt) {
+    std::vector<std::vector<std::pair<K, RowId>>> runs(parts);
+    forEachPart(source, [&](size_t part, const Batch& batch) {
+        for (size_t i = 0; i < batch.count; ++i) {
+            RowId row = batch.row(i);
+            runs[part].emplace_back(keyAt(row), row);
+        }
+    });
+    std::vector<std::pair<K, RowId>> entries;
+    for (auto& run : runs) {
+        entries.insert(entries.end(), std::make_move_iterator(run.begin()), std::make_move_iterator(run.end()));
+        std::vector<std::pair<K, RowId>>().swap(run);
+    }
+    parallelSort(entries, threads);
+
+    GroupedResult result;
+    size_t stride = specs.size();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        RowId row = entries[i].second;
+        if (i == 0 || !(entries[i - 1].first == entries[i].first)) {
+            result.keyRows.push_back(row);
+            result.states.resize(result.states.size() + stride);
+        }
+        Accumulator* states = result.states.data() + result.states.size() - stride;
+        for (size_t s = 0; s < stride; ++s) states[s].addRow(specs[s], data, row);
+    }
+    return result;
+}
+
+template <typename K, typename KeyAt>
+GroupedResult groupBy(const std::vector<Column>& data, const std::vector<AggregateSpec>& specs, BatchSource& source,
+                      GroupStrategy strategy, KeyAt keyAt) {
+    auto* parallel = dynamic_cast<ParallelScan*>(&source);
+    size_t parts = parallel ? parallel->morselCount() : 1;
+    size_t threads = parallel ? parallel->threadCount() : 1;
+    if (strategy == GroupStrategy::SORT) return sortGroups<K>(data, specs, source, parts, threads, keyAt);
+    return hashGroups<K>(data, specs, source, parts, threads, keyAt);
+}
+
+} // namespace
+
+GroupedResult groupRows(const std::vector<Column>& data, const std::vector<int>& keyColumns,
+                        const std::vector<AggregateSpec>& specs, BatchSource& source, GroupStrategy strategy) {
+    // One INT or REAL key column is hashed and compared as a plain number;
+    // anything else goes through the order-preserving key encoding
+    if (keyColumns.size() == 1 && data[keyColumns[0]].type() != TEXT) {
+        const Column& column = data[keyColumns[0]];
+        if (column.type() == INT) {
+            const std::vector<int32_t>& values = column.ints();
+            return groupBy<int32_t>(data, specs, source, strategy, [&](RowId row) { return values[row]; });
+        }
+        const std::vector<double>& values = column.reals();
+        return groupBy<double>(data, specs, source, strategy, [&](RowId row) { return values[row]; });
+    }
+    if (keyColumns.size() == 1) {
+        const std::vector<std::string>& values = data[keyColumns[0]].texts();
+        return groupBy<std::string>(data, specs, source, strategy, [&](RowId row) { return values[row]; });
+    }
+    return groupBy<std::string>(data, specs, source, strategy, [&](RowId row) {
+        std::string key;
+        for (int column : keyColumns) appendEncodedKey(key, data[column], row);
+        return key;
+    });
+}
+
+bool parseAggregateCall(const std::string& text, AggregateFunction& function, std::string& argument) {
+    size_t open = text.find('(');
+    if (open == std::string::npos || text.empty() || text.back() != ')') return false;
+    std::string name = text.substr(0, open);
+    name.erase(std::remove_if(name.begin(), name.end(), [](unsigned char c) { return std::isspace(c); }), name.end());
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    if (name == "COUNT") function = AggregateFunction::COUNT;
+    else if (name == "SUM") function = AggregateFunction::SUM;
+    else if (name == "AVG") function = AggregateFunction::AVG;
+    else if (name == "MIN") function = AggregateFunction::MIN;
+    else if (name == "MAX") function = AggregateFunction::MAX;
+    else return false;
+    argument = text.substr(open + 1, text.size() - open - 2);
+    size_t first = argument.find_first_not_of(" \t");
+    size_t last = argument.find_last_not_of(" \t");
+    argument = first == std::string::npos ? "" : argument.substr(first, last - first + 1);
+    return true;
+}
+
+void Accumulator::add(const AggregateSpec& spec, const std::vector<Column>& data, const Batch& batch) {
+    if (batch.count == 0) return;
+    if (spec.function != AggregateFunction::COUNT) {
+        const Column& column = data[spec.column];
+        bool first = count == 0;
+        switch (column.type()) {
+            case INT: foldNumbers(column.ints(), batch, spec.function, first, intSum, intMin, intMax); break;
+            case REAL: foldNumbers(column.reals(), batch, spec.function, first, realSum, realMin, realMax); break;
+            default: foldTexts(column.texts(), batch, spec.function, first, textMin, textMax); break;
+        }
+    }
+    count += batch.count;
+}
+
+void Accumulator::addRow(const AggregateSpec& spec, const std::vector<Column>& data, RowId row) {
+    if (spec.function != AggregateFunction::COUNT) {
+        const Column& column = data[spec.column];
+        bool first = count == 0;
+        switch (column.type()) {
+            case INT: foldValue(column.ints()[row], spec.function, first, intSum, intMin, intMax); break;
+            case REAL: foldValue(column.reals()[row], spec.function, first, realSum, realMin, realMax); break;
+            default: foldValue(column.texts()[row], spec.function, first, intSum, textMin, textMax); break;
+        }
+    }
+    ++count;
+}
+
+void Accumulator::merge(const AggregateSpec& spec, const Accumulator& other) {
+    if (other.count == 0) return;
+    bool first = count == 0;
+    count += other.count;
+    intSum += other.intSum;
+    realSum += other.realSum;
+    if (spec.function == AggregateFunction::MIN) {
+        switch (spec.type) {
+            case INT: intMin = first ? other.intMin : std::min(intMin, other.intMin); break;
+            case REAL: realMin = first ? other.realMin : std::min(realMin, other.realMin); break;
+            default: if (first || other.textMin < textMin) textMin = other.textMin; break;
+        }
+    } else if (spec.function == AggregateFunction::MAX) {
+        switch (spec.type) {
+            case INT: intMax = first ? other.intMax : std::max(intMax, other.intMax); break;
+            case REAL: realMax = first ? other.realMax : std::max(realMax, other.realMax); break;
+            default: if (first || textMax < other.textMax) textMax = other.textMax; break;
+        }
+    }
+}
+
+std::string Accumulator::result(const AggregateSpec& spec) const {
+    std::ostringstream text;
+    if (spec.function == AggregateFunction::COUNT) {
+        text << count;
+        return text.str();
+    }
+    if (count == 0) return "NULL";
+    switch (spec.function) {
+        case AggregateFunction::SUM:
+            if (spec.type == INT) text << intSum;
+            else text << realSum;
+            break;
+        case AggregateFunction::AVG:
+            text << (spec.type == INT ? static_cast<double>(intSum) : realSum) / count;
+            break;
+        case AggregateFunction::MIN:
+            if (spec.type == INT) text << intMin;
+            else if (spec.type == REAL) text << realMin;
+            else text << textMin;
+            break;
+        default:
+            if (spec.type == INT) text << intMax;
+            else if (spec.type == REAL) text << realMax;
+            else text << textMax;
+            break;
+    }
+    return text.str();
+}
@@ -0,0 +1,75 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "column.h"
+#include "exec.h"
+
+// Aggregate functions of a SELECT list
+enum class AggregateFunction {
+    COUNT,
+    SUM,
+    AVG,
+    MIN,
+    MAX
+};
+
+// One aggregate of a SELECT list, resolved against the table schema
+struct AggregateSpec {
+    AggregateFunction function = AggregateFunction::COUNT;
+    int column = -1; // -1 for COUNT(*)
+    DataType type = INT;
+    std::string label; // Output heading, e.g. "SUM(price)"
+};
+
+// Splits a call such as "SUM(price)" into its function and argument. Returns
+// false when text is not a call of one of the aggregate functions.
+bool parseAggregateCall(const std::string& text, AggregateFunction& function, std::string& argument);
+
+// Running state of one aggregate. add() folds in the rows of a batch with one
+// typed loop over the column array, so rows never become Values; states built
+// over disjoint sets of rows combine with merge().
+struct Accumulator {
+    uint64_t count = 0; // Rows folded in
+    int64_t intSum = 0;
+    double realSum = 0.0;
+    int32_t intMin = 0, intMax = 0;
+    double realMin = 0.0, realMax = 0.0;
+    std::string textMin, textMax;
+
+    void add(const AggregateSpec& spec, const std::vector<Column>& data, const Batch& batch);
+    void addRow(const AggregateSpec& spec, const std::vector<Column>& data, RowId row);
+    void merge(const AggregateSpec& spec, const Accumulator& other);
+    // The final value as printed. SUM, AVG, MIN and MAX of no rows are NULL.
+    std::string result(const AggregateSpec& spec) const;
+};
+
+// How GROUP BY brings the rows of a group together
+enum class GroupStrategy {
+    HASH, // Per-morsel hash tables merged partition by partition
+    SORT  // Rows sorted by key, then folded run by run
+};
+
+// Beyond this many groups GROUP BY sorts instead of hashing: the per-morsel
+// tables would outgrow the caches and pre-aggregation would merge almost nothing
+constexpr size_t HASH_AGGREGATION_MAX_GROUPS = 1 << 20;
+
+// Groups of a GROUP BY. Group g reads its key values from row keyRows[g] and
+// keeps its aggregates in states[g * specCount .. (g + 1) * specCount).
+struct GroupedResult {
+    std::vector<RowId> keyRows;
+    std::vector<Accumulator> states;
+};
+
+// Folds the rows source produces into one group per distinct combination of
+// the key columns. A ParallelScan runs its morsels in parallel, each into its
+// own hash table (or sorted run), before the partial results are combined.
+// Hash aggregation returns the groups in order of first appearance within
+// each hash partition; sort aggregation returns them in key order. Both give
+// the same order however many threads run.
+GroupedResult groupRows(const std::vector<Column>& data, const std::vector<int>& keyColumns,
+                        const std::vector<AggregateSpec>& specs, BatchSource& source, GroupStrategy strategy);
+
+#endif // AGGREGATE_H
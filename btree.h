@@ -0,0 +1,357 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <limits>
+
+using RowId = uint32_t;
+
+// In-memory B+tree mapping keys to row ids. Entries are ordered by
+// (key, row) so duplicate keys are allowed and every entry is unique.
+// Nodes keep keys and row ids in fixed inline arrays, and leaves are fat and
+// doubly linked, so a range scan is one root-to-leaf seek followed by a
+// sequential walk over contiguous leaf arrays.
+//
+// Erase is lazy: leaves may become underfull or empty but are never merged.
+// Rebuilding with bulkLoad() restores full leaves.
+template <typename Key, size_t LeafCapacity = 128, size_t InnerCapacity = 64>
+class BPlusTree {
+    struct Node {
+        bool isLeaf;
+        uint16_t count = 0;
+        explicit Node(bool leaf) : isLeaf(leaf) {}
+    };
+
+    // One spare slot lets a node overflow by one entry before it is split
+    struct Leaf : Node {
+        Key keys[LeafCapacity + 1];
+        RowId rows[LeafCapacity + 1];
+        Leaf* prev = nullptr;
+        Leaf* next = nullptr;
+        Leaf() : Node(true) {}
+    };
+
+    struct Inner : Node {
+        Key keys[InnerCapacity + 1];
+        RowId rows[InnerCapacity + 1];
+        Node* children[InnerCapacity + 2];
+        Inner() : Node(false) {}
+    };
+
+    struct Split {
+        bool happened = false;
+        Key key{};
+        RowId row = 0;
+        Node* right = nullptr;
+    };
+
+public:
+    // Position of an entry inside a leaf; invalid once leaf is null
+    class Cursor {
+    public:
+        bool valid() const { return leaf != nullptr; }
+        const Key& key() const { return leaf->keys[pos]; }
+        RowId row() const { return leaf->rows[pos]; }
+
+        void next() {
+            ++pos;
+            while (leaf && pos >= leaf->count) {
+                leaf = leaf->next;
+                pos = 0;
+            }
+        }
+
+        void prev() {
+            while (leaf && pos == 0) {
+                leaf = leaf->prev;
+                pos = leaf ? leaf->count : 0;
+            }
+            if (leaf) --pos;
+        }
+
+    private:
+        friend class BPlusTree;
+        Cursor(const Leaf* l, size_t p) : leaf(l), pos(p) {}
+        const Leaf* leaf;
+        size_t pos;
+    };
+
+    BPlusTree() = default;
+    ~BPlusTree() { destroy(root); }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    size_t size() const { return entryCount; }
+    bool empty() const { return entryCount == 0; }
+
+    void clear() {
+        destroy(root);
+        root = nullptr;
+        firstLeaf = lastLeaf = nullptr;
+        entryCount = 0;
+    }
+
+    void insert(const Key& key, RowId row) {
+        if (!root) {
+            Leaf* leaf = new Leaf();
+            root = firstLeaf = lastLeaf = leaf;
+        }
+        bool inserted = false;
+        Split split = insertInto(root, key, row, inserted);
+        if (split.happened) {
+            Inner* newRoot = new Inner();
+            newRoot->keys[0] = split.key;
+            newRoot->rows[0] = split.row;
+            newRoot->children[0] = root;
+            newRoot->children[1] = split.right;
+            newRoot->count = 1;
+            root = newRoot;
+        }
+        if (inserted) ++entryCount;
+    }
+
+    bool erase(const Key& key, RowId row) {
+        if (!root) return false;
+        Node* node = root;
+        while (!node->isLeaf) {
+            Inner* inner = static_cast<Inner*>(node);
+            node = inner->children[upperBound(inner->keys, inner->rows, inner->count, key, row)];
+        }
+        Leaf* leaf = static_cast<Leaf*>(node);
+        size_t pos = lowerBound(leaf->keys, leaf->rows, leaf->count, key, row);
+        if (pos >= leaf->count || less(key, leaf->keys[pos]) || leaf->rows[pos] != row) {
+            return false;
+        }
+        for (size_t i = pos + 1; i < leaf->count; ++i) {
+            leaf->keys[i - 1] = std::move(leaf->keys[i]);
+            leaf->rows[i - 1] = leaf->rows[i];
+        }
+        --leaf->count;
+        --entryCount;
+        return true;
+    }
+
+    // First entry not less than (key, row)
+    Cursor seek(const Key& key, RowId row = 0) const {
+        if (!root) return Cursor(nullptr, 0);
+        const Node* node = root;
+        while (!node->isLeaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[upperBound(inner->keys, inner->rows, inner->count, key, row)];
+        }
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        Cursor cursor(leaf, lowerBound(leaf->keys, leaf->rows, leaf->count, key, row));
+        if (cursor.pos >= leaf->count) {
+            cursor.pos = leaf->count == 0 ? 0 : leaf->count - 1;
+            cursor.next();
+        }
+        return cursor;
+    }
+
+    // First entry whose key is greater than key
+    Cursor seekAfter(const Key& key) const {
+        Cursor cursor = seek(key, std::numeric_limits<RowId>::max());
+        while (cursor.valid() && !less(key, cursor.key())) cursor.next();
+        return cursor;
+    }
+
+    Cursor begin() const {
+        Cursor cursor(firstLeaf, 0);
+        if (firstLeaf && firstLeaf->count == 0) cursor.next();
+        return cursor;
+    }
+
+    Cursor last() const {
+        Cursor cursor(lastLeaf, lastLeaf ? lastLeaf->count : 0);
+        cursor.prev();
+        return cursor;
+    }
+
+    // Replaces the contents with entries already sorted by (key, row)
+    void bulkLoad(std::vector<std::pair<Key, RowId>>&& entries) {
+        clear();
+        if (entries.empty()) return;
+
+        std::vector<Node*> level;
+        std::vector<std::pair<Key, RowId>> minima;
+        Leaf* previous = nullptr;
+        for (size_t start = 0; start < entries.size(); start += LeafCapacity) {
+            size_t end = std::min(entries.size(), start + LeafCapacity);
+            Leaf* leaf = new Leaf();
+            for (size_t i = start; i < end; ++i) {
+                leaf->keys[i - start] = std::move(entries[i].first);
+                leaf->rows[i - start] = entries[i].second;
+            }
+            leaf->count = static_cast<uint16_t>(end - start);
+            leaf->prev = previous;
+            if (previous) previous->next = leaf;
+            else firstLeaf = leaf;
+            previous = leaf;
+            level.push_back(leaf);
+            minima.emplace_back(leaf->keys[0], leaf->rows[0]);
+        }
+        lastLeaf = previous;
+        entryCount = entries.size();
+
+        while (level.size() > 1) {
+            std::vector<Node*> parents;
+            std::vector<std::pair<Key, RowId>> parentMinima;
+            const size_t fanout = InnerCapacity + 1;
+            for (size_t start = 0, end; start < level.size(); start = end) {
+                end = std::min(level.size(), start + fanout);
+                // Rather than leave a trailing parent with a single child, the
+                // last two parents split their children evenly
+                if (level.size() - end == 1) end = start + (level.size() - start + 1) / 2;
+                Inner* inner = new Inner();
+                inner->children[0] = level[start];
+                for (size_t i = start + 1; i < end; ++i) {
+                    inner->keys[i - start - 1] = minima[i].first;
+                    inner->rows[i - start - 1] = minima[i].second;
+                    inner->children[i - start] = level[i];
+                }
+                inner->count = static_cast<uint16_t>(end - start - 1);
+                parents.push_back(inner);
+                parentMinima.push_back(minima[start]);
+            }
+            level = std::move(parents);
+            minima = std::move(parentMinima);
+        }
+        root = level[0];
+    }
+
+private:
+    Node* root = nullptr;
+    Leaf* firstLeaf = nullptr;
+    Leaf* lastLeaf = nullptr;
+    size_t entryCount = 0;
+
+    static bool less(const Key& a, const Key& b) { return a < b; }
+
+    static bool entryLess(const Key& ak, RowId ar, const Key& bk, RowId br) {
+        if (ak < bk) return true;
+        if (bk < ak) return false;
+        return ar < br;
+    }
+
+    // Index of the first entry >= (key, row)
+    static size_t lowerBound(const Key* keys, const RowId* rows, size_t count, const Key& key, RowId row) {
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (entryLess(keys[mid], rows[mid], key, row)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Index of the first entry > (key, row)
+    static size_t upperBound(const Key* keys, const RowId* rows, size_t count, const Key& key, RowId row) {
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (entryLess(key, row, keys[mid], rows[mid])) hi = mid;
+            else lo = mid + 1;
+        }
+        return lo;
+    }
+
+    Split insertInto(Node* node, const Key& key, RowId row, bool& inserted) {
+        Split split;
+        if (node->isLeaf) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            size_t pos = lowerBound(leaf->keys, leaf->rows, leaf->count, key, row);
+            if (pos < leaf->count && !less(key, leaf->keys[pos]) && leaf->rows[pos] == row) {
+                return split; // Entry already present
+            }
+            for (size_t i = leaf->count; i > pos; --i) {
+                leaf->keys[i] = std::move(leaf->keys[i - 1]);
+                leaf->rows[i] = leaf->rows[i - 1];
+            }
+            leaf->keys[pos] = key;
+            leaf->rows[pos] = row;
+            ++leaf->count;
+            inserted = true;
+            if (leaf->count > LeafCapacity) split = splitLeaf(leaf);
+            return split;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        size_t childPos = upperBound(inner->keys, inner->rows, inner->count, key, row);
+        Split childSplit = insertInto(inner->children[childPos], key, row, inserted);
+        if (!childSplit.happened) return split;
+
+        for (size_t i = inner->count; i > childPos; --i) {
+            inner->keys[i] = std::move(inner->keys[i - 1]);
+            inner->rows[i] = inner->rows[i - 1];
+            inner->children[i + 1] = inner->children[i];
+        }
+        inner->keys[childPos] = std::move(childSplit.key);
+        inner->rows[childPos] = childSplit.row;
+        inner->children[childPos + 1] = childSplit.right;
+        ++inner->count;
+        if (inner->count > InnerCapacity) split = splitInner(inner);
+        return split;
+    }
+
+    Split splitLeaf(Leaf* leaf) {
+        Leaf* right = new Leaf();
+        size_t keep = leaf->count / 2;
+        for (size_t i = keep; i < leaf->count; ++i) {
+            right->keys[i - keep] = std::move(leaf->keys[i]);
+            right->rows[i - keep] = leaf->rows[i];
+        }
+        right->count = static_cast<uint16_t>(leaf->count - keep);
+        leaf->count = static_cast<uint16_t>(keep);
+
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next) leaf->next->prev = right;
+        else lastLeaf = right;
+        leaf->next = right;
+
+        Split split;
+        split.happened = true;
+        split.key = right->keys[0];
+        split.row = right->rows[0];
+        split.right = right;
+        return split;
+    }
+
+    Split splitInner(Inner* inner) {
+        Inner* right = new Inner();
+        size_t mid = inner->count / 2;
+        Split split;
+        split.happened = true;
+        split.key = std::move(inner->keys[mid]);
+        split.row = inner->rows[mid];
+        split.right = right;
+
+        for (size_t i = mid + 1; i < inner->count; ++i) {
+            right->keys[i - mid - 1] = std::move(inner->keys[i]);
+            right->rows[i - mid - 1] = inner->rows[i];
+        }
+        for (size_t i = mid + 1; i <= inner->count; ++i) {
+            right->children[i - mid - 1] = inner->children[i];
+        }
+        right->count = static_cast<uint16_t>(inner->count - mid - 1);
+        inner->count = static_cast<uint16_t>(mid);
+        return split;
+    }
+
+    static void destroy(Node* node) {
+        if (!node) return;
+        if (node->isLeaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (size_t i = 0; i <= inner->count; ++i) destroy(inner->children[i]);
+        delete inner;
+    }
+};
+
+#endif // BTREE_H
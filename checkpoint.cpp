@@ -0,0 +1,180 @@
+#include "checkpoint.h"
+#include "snapshot.h"
+#include <cstring>
+#include <cerrno>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+void writeLine(int fd, const std::string& line) {
+    std::string data = line + "\n";
+    const char* bytes = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        bytes += written;
+        remaining -= static_cast<size_t>(written);
+    }
+}
+
+std::string percent(uint64_t done, uint64_t total) {
+    return std::to_string(total == 0 ? 100 : done * 100 / total) + "%";
+}
+
+} // namespace
+
+BackgroundSaver::BackgroundSaver(Database& db) : database(db) {}
+
+BackgroundSaver::~BackgroundSaver() {
+    if (monitor.joinable()) {
+        if (active) {
+            std::cout << "Waiting for the background save to '" << filename << "' to finish..." << std::endl;
+        }
+        monitor.join();
+    }
+}
+
+void BackgroundSaver::start(const std::string& target) {
+    if (active) {
+        throw std::runtime_error("A background save to '" + filename + "' is already running.");
+    }
+    if (monitor.joinable()) {
+        monitor.join();
+    }
+
+    // Everything logged up to here is part of the image the child will save
+    uint64_t walMark = database.wal ? database.wal->mark() : 0;
+
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        throw std::runtime_error(std::string("Failed to create pipe for background save: ") + std::strerror(errno));
+    }
+    // Unflushed output would otherwise be written twice, once by each process
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        throw std::runtime_error(std::string("Failed to start background save: ") + std::strerror(errno));
+    }
+    if (pid == 0) {
+        // Child: only this thread exists here, so stay away from the WAL and the console
+        ::close(fds[0]);
+        int status = 0;
+        try {
+            uint64_t lastPercent = 0;
+            Snapshot::save(database, target, [&](uint64_t done, uint64_t total) {
+                uint64_t current = total == 0 ? 100 : done * 100 / total;
+                if (current != lastPercent || done == total) {
+                    lastPercent = current;
+                    writeLine(fds[1], "P " + std::to_string(done) + " " + std::to_string(total));
+                }
+            });
+            writeLine(fds[1], "OK");
+        } catch (const std::exception& e) {
+            writeLine(fds[1], std::string("ERR ") + e.what());
+            status = 1;
+        }
+        ::_exit(status);
+    }
+
+    ::close(fds[1]);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        filename = target;
+        child = pid;
+        cellsDone = 0;
+        cellsTotal = 0;
+        completion.clear();
+        lastStatus = "Background save to '" + target + "' started.";
+    }
+    active = true;
+    monitor = std::thread(&BackgroundSaver::watch, this, fds[0], walMark, std::chrono::steady_clock::now());
+}
+
+void BackgroundSaver::watch(int readFd, uint64_t walMark, std::chrono::steady_clock::time_point started) {
+    std::string buffer, error;
+    bool succeeded = false;
+    char chunk[256];
+    ssize_t count;
+    while ((count = ::read(readFd, chunk, sizeof(chunk))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(count));
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (line.compare(0, 2, "P ") == 0) {
+                std::istringstream progress(line.substr(2));
+                std::lock_guard<std::mutex> lock(mutex);
+                progress >> cellsDone >> cellsTotal;
+            } else if (line == "OK") {
+                succeeded = true;
+            } else if (line.compare(0, 4, "ERR ") == 0) {
+                error = line.substr(4);
+            }
+        }
+    }
+    ::close(readFd);
+
+    int status = 0;
+    while (::waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        succeeded = false;
+        if (error.empty()) error = "save process exited abnormally";
+    }
+
+    // The snapshot holds everything up to the fork; keep only later log records
+    if (succeeded && database.wal) {
+        try {
+            database.wal->rebase(filename, walMark);
+        } catch (const std::runtime_error& e) {
+            succeeded = false;
+            error = std::string("snapshot written but the write-ahead log could not be rebased: ") + e.what();
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::ostringstream message;
+    if (succeeded) {
+        message << "Background save of '" << database.name << "' to '" << filename << "' finished in "
+                << std::fixed << std::setprecision(2) << seconds << "s.";
+    } else {
+        message << "Background save to '" << filename << "' failed: " << error;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastStatus = message.str();
+        completion = message.str();
+    }
+    active = false;
+}
+
+std::string BackgroundSaver::status() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active && cellsTotal == 0) {
+        return "Background save to '" + filename + "' in progress.";
+    }
+    if (active) {
+        return "Background save to '" + filename + "' in progress: " + percent(cellsDone, cellsTotal) +
+               " (" + std::to_string(cellsDone) + "/" + std::to_string(cellsTotal) + " values written).";
+    }
+    return lastStatus;
+}
+
+std::string BackgroundSaver::takeCompletion() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string message;
+    message.swap(completion);
+    return message;
+}
@@ -0,0 +1,48 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+#include "hexadb.h"
+
+// Writes snapshots without blocking the REPL. start() forks the process; the
+// child inherits a copy-on-write image of every table, so it sees the database
+// exactly as it was at the fork and saves it while the parent keeps serving
+// queries. Pages are only copied when the parent modifies them.
+//
+// The child reports progress over a pipe. A monitor thread in the parent
+// collects it, reaps the child, and on success rebases the write-ahead log so
+// it only keeps the changes made after the fork.
+class BackgroundSaver {
+public:
+    explicit BackgroundSaver(Database& db);
+    ~BackgroundSaver(); // Waits for a running save to finish
+
+    // Throws if a save is already running
+    void start(const std::string& filename);
+    bool running() const { return active; }
+    // One-line description of the current or last save
+    std::string status() const;
+    // Returns the completion message of a finished save once, then empty strings
+    std::string takeCompletion();
+
+private:
+    Database& database;
+    std::atomic<bool> active{false};
+    std::thread monitor;
+    mutable std::mutex mutex;
+    std::string filename;
+    pid_t child = -1;
+    uint64_t cellsDone = 0;
+    uint64_t cellsTotal = 0;
+    std::string lastStatus = "No background save has run.";
+    std::string completion;
+
+    void watch(int readFd, uint64_t walMark, std::chrono::steady_clock::time_point started);
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,88 @@
+#include "column.h"
+
+Column::Column(DataType type) : dataType(type) {}
+
+size_t Column::size() const {
+    switch (dataType) {
+        case INT: return intData.size();
+        case REAL: return realData.size();
+        default: return textData.size();
+    }
+}
+
+void Column::reserve(size_t n) {
+    switch (dataType) {
+        case INT: intData.reserve(n); break;
+        case REAL: realData.reserve(n); break;
+        default: textData.reserve(n); break;
+    }
+}
+
+void Column::resize(size_t n) {
+    switch (dataType) {
+        case INT: intData.resize(n); break;
+        case REAL: realData.resize(n); break;
+        default: textData.resize(n); break;
+    }
+}
+
+void Column::clear() {
+    intData.clear();
+    realData.clear();
+    textData.clear();
+}
+
+void Column::checkType(const Value& value) const {
+    bool matches = (dataType == INT && std::holds_alternative<int>(value)) ||
+                   (dataType == REAL && std::holds_alternative<double>(value)) ||
+                   (dataType == TEXT && std::holds_alternative<std::string>(value));
+    if (!matches) {
+        throw std::runtime_error("Value type does not match column type.");
+    }
+}
+
+void Column::append(const Value& value) {
+    checkType(value);
+    switch (dataType) {
+        case INT: intData.push_back(std::get<int>(value)); break;
+        case REAL: realData.push_back(std::get<double>(value)); break;
+        default: textData.push_back(std::get<std::string>(value)); break;
+    }
+}
+
+void Column::set(size_t row, const Value& value) {
+    checkType(value);
+    switch (dataType) {
+        case INT: intData[row] = std::get<int>(value); break;
+        case REAL: realData[row] = std::get<double>(value); break;
+        default: textData[row] = std::get<std::string>(value); break;
+    }
+}
+
+Value Column::get(size_t row) const {
+    switch (dataType) {
+        case INT: return intData[row];
+        case REAL: return realData[row];
+        default: return textData[row];
+    }
+}
+
+template <typename T>
+static void compactVector(std::vector<T>& data, const std::vector<bool>& keep) {
+    size_t out = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (keep[i]) {
+            if (out != i) data[out] = std::move(data[i]);
+            ++out;
+        }
+    }
+    data.resize(out);
+}
+
+void Column::compact(const std::vector<bool>& keep) {
+    switch (dataType) {
+        case INT: compactVector(intData, keep); break;
+        case REAL: compactVector(realData, keep); break;
+        default: compactVector(textData, keep); break;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <variant>
+#include <stdexcept>
+
+// Supported data types
+enum DataType {
+    INT,
+    TEXT,
+    REAL
+};
+
+// Type alias for values in a row
+using Value = std::variant<int, std::string, double>;
+
+// Contiguous, typed storage for a single table column. Only the vector that
+// matches the column's data type is populated, so a scan over an INT column
+// walks a plain int32_t array.
+class Column {
+public:
+    explicit Column(DataType type);
+
+    DataType type() const { return dataType; }
+    size_t size() const;
+    void reserve(size_t n);
+    void resize(size_t n);
+    void clear();
+
+    void append(const Value& value);
+    void set(size_t row, const Value& value);
+    Value get(size_t row) const;
+    // Drops every row whose entry in keep is false, preserving order
+    void compact(const std::vector<bool>& keep);
+
+    // Direct access to the typed arrays for tight loops
+    const std::vector<int32_t>& ints() const { return intData; }
+    const std::vector<double>& reals() const { return realData; }
+    const std::vector<std::string>& texts() const { return textData; }
+    std::vector<int32_t>& ints() { return intData; }
+    std::vector<double>& reals() { return realData; }
+    std::vector<std::string>& texts() { return textData; }
+
+private:
+    DataType dataType;
+    std::vector<int32_t> intData;
+    std::vector<double> realData;
+    std::vector<std::string> textData;
+
+    void checkType(const Value& value) const;
+};
+
+#endif // COLUMN_H
@@ -39,6 +39,22 @@ public:
         }
         throw std::runtime_error("GEMINI_API_KEY not found in config file");
     }
+
+    // Returns the value of an optional KEY=value setting, or defaultValue when absent
+    static std::string getValue(const std::string& key, const std::string& defaultValue,
+                                const std::string& configFile = "config.txt") {
+        std::ifstream file(configFile);
+        std::string line;
+        const std::string prefix = key + "=";
+        while (std::getline(file, line)) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#') continue;
+            if (line.substr(0, prefix.length()) == prefix) {
+                return trim(line.substr(prefix.length()));
+            }
+        }
+        return defaultValue;
+    }
 };
 
 #endif // CONFIG_READER_H
@@ -0,0 +1,329 @@
+#include "exec.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "sort.h"
+#include "thread_pool.h"
+
+namespace {
+
+std::atomic<size_t> scanThreadSetting{0};
+
+} // namespace
+
+void setScanThreads(size_t threads) {
+    scanThreadSetting = threads;
+}
+
+size_t scanThreads() {
+    return scanThreadSetting;
+}
+
+size_t scanThreadsFor(size_t rows) {
+    if (rows < PARALLEL_SCAN_MIN_ROWS) return 1;
+    size_t poolSize = ThreadPool::shared().size();
+    size_t threads = scanThreadSetting == 0 ? poolSize : std::min<size_t>(scanThreadSetting, poolSize + 1);
+    size_t morsels = (rows + MORSEL_ROWS - 1) / MORSEL_ROWS;
+    return std::max<size_t>(1, std::min(threads, morsels));
+}
+
+size_t valueBytes(DataType type) {
+    switch (type) {
+        case INT: return sizeof(int32_t);
+        case REAL: return sizeof(double);
+        default: return sizeof(std::string);
+    }
+}
+
+Profiled::Profiled(std::unique_ptr<BatchSource> input, OperatorProfile& stats) : source(std::move(input)), profile(stats) {}
+
+bool Profiled::next(Batch& batch) {
+    auto start = std::chrono::steady_clock::now();
+    bool more = source->next(batch);
+    profile.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (more) profile.rowsOut += batch.count;
+    return more;
+}
+
+TableScan::TableScan(const std::vector<bool>& deletedRows, size_t deletedCount, size_t begin, size_t endRow)
+    : deleted(deletedRows), anyDeleted(deletedCount > 0), position(begin), end(endRow) {}
+
+bool TableScan::next(Batch& batch) {
+    while (position < end) {
+        size_t count = std::min(BATCH_SIZE, end - position);
+        RowId first = static_cast<RowId>(position);
+        position += count;
+        if (rowsRead) *rowsRead += count;
+        if (!anyDeleted) {
+            batch.dense = true;
+            batch.first = first;
+            batch.count = count;
+            return true;
+        }
+        // Tombstones are rare and clustered, so testing them per row is cheap
+        size_t selected = 0;
+        for (size_t i = 0; i < count; ++i) {
+            batch.rows[selected] = first + static_cast<RowId>(i);
+            selected += !deleted[first + i];
+        }
+        if (selected > 0) {
+            batch.dense = false;
+            batch.count = selected;
+            return true;
+        }
+    }
+    return false;
+}
+
+RowListScan::RowListScan(std::vector<RowId> rowList) : rows(std::move(rowList)) {}
+
+bool RowListScan::next(Batch& batch) {
+    if (position == rows.size()) return false;
+    size_t count = std::min(BATCH_SIZE, rows.size() - position);
+    std::copy(rows.begin() + position, rows.begin() + position + count, batch.rows.begin());
+    position += count;
+    batch.dense = false;
+    batch.count = count;
+    return true;
+}
+
+Filter::Filter(std::unique_ptr<BatchSource> input, const std::vector<Column>& tableData, Condition filterCondition)
+    : source(std::move(input)), data(tableData), condition(std::move(filterCondition)) {}
+
+bool Filter::next(Batch& batch) {
+    while (source->next(batch)) {
+        if (batch.dense) {
+            batch.count = condition.selectRange(data, batch.first, batch.count, batch.rows.data());
+            batch.dense = false;
+        } else {
+            batch.count = condition.selectRows(data, batch.rows.data(), batch.count, batch.rows.data());
+        }
+        if (batch.count > 0) return true;
+    }
+    return false;
+}
+
+ParallelScan::ParallelScan(const std::vector<Column>& tableData, const std::vector<bool>& deletedRows, size_t deletedRowCount,
+                           size_t rowCount, std::vector<Condition> scanFilters, size_t threadCount)
+    : data(tableData), deleted(deletedRows), deletedCount(deletedRowCount), rows(rowCount), filters(std::move(scanFilters)), threads(threadCount) {}
+
+void ParallelScan::forEachBatch(const std::function<void(size_t, const Batch&)>& consume) {
+    runMorsels(0, morselCount(), consume);
+}
+
+void ParallelScan::runMorsels(size_t first, size_t last, const std::function<void(size_t, const Batch&)>& consume) {
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> kept{0};
+    ThreadPool::shared().parallelFor(last - first, [&](size_t i) {
+        size_t m = first + i;
+        size_t begin = m * MORSEL_ROWS;
+        std::unique_ptr<BatchSource> source = std::make_unique<TableScan>(deleted, deletedCount, begin, std::min(rows, begin + MORSEL_ROWS));
+        for (const auto& filter : filters) {
+            source = std::make_unique<Filter>(std::move(source), data, filter);
+        }
+        Batch batch;
+        size_t morselKept = 0;
+        while (source->next(batch)) {
+            morselKept += batch.count;
+            consume(m, batch);
+        }
+        kept += morselKept;
+    }, std::min(threads, last - first));
+    size_t read = std::min(rows, last * MORSEL_ROWS) - first * MORSEL_ROWS;
+    if (rowsRead) *rowsRead += read;
+    if (profile) {
+        profile->rowsIn += read;
+        profile->rowsOut += kept;
+        profile->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void ParallelScan::scanNextWave() {
+    size_t first = scannedMorsels;
+    size_t last = first + std::min(waveMorsels, morselCount() - first);
+    morselRows.resize(last);
+    runMorsels(first, last, [&](size_t m, const Batch& batch) {
+        std::vector<RowId>& out = morselRows[m];
+        for (size_t i = 0; i < batch.count; ++i) out.push_back(batch.row(i));
+    });
+    scannedMorsels = last;
+}
+
+bool ParallelScan::next(Batch& batch) {
+    while (true) {
+        if (morsel == scannedMorsels) {
+            if (scannedMorsels == morselCount()) return false;
+            scanNextWave();
+        }
+        if (position < morselRows[morsel].size()) break;
+        std::vector<RowId>().swap(morselRows[morsel]); // Done with it
+        ++morsel;
+        position = 0;
+    }
+    const std::vector<RowId>& source = morselRows[morsel];
+    size_t count = std::min(BATCH_SIZE, source.size() - position);
+    std::copy(source.begin() + position, source.begin() + position + count, batch.rows.begin());
+    position += count;
+    batch.dense = false;
+    batch.count = count;
+    return true;
+}
+
+Limit::Limit(std::unique_ptr<BatchSource> input, size_t limit, size_t offset)
+    : source(std::move(input)), remaining(limit), skip(offset) {}
+
+bool Limit::next(Batch& batch) {
+    while (remaining > 0 && source->next(batch)) {
+        size_t begin = std::min(skip, batch.count);
+        skip -= begin;
+        size_t count = std::min(remaining, batch.count - begin);
+        if (count == 0) continue;
+        if (batch.dense) {
+            batch.first += static_cast<RowId>(begin);
+        } else if (begin > 0) {
+            std::copy(batch.rows.begin() + begin, batch.rows.begin() + begin + count, batch.rows.begin());
+        }
+        batch.count = count;
+        remaining -= count;
+        return true;
+    }
+    return false;
+}
+
+RowOrder::RowOrder(const std::vector<Column>& tableData, std::vector<SortKey> sortKeys)
+    : data(tableData), keys(std::move(sortKeys)) {}
+
+bool RowOrder::operator()(RowId left, RowId right) const {
+    for (const SortKey& key : keys) {
+        const Column& column = data[key.column];
+        int order;
+        switch (column.type()) {
+            case INT: {
+                int a = column.ints()[left], b = column.ints()[right];
+                order = (a > b) - (a < b);
+                break;
+            }
+            case REAL: {
+                double a = column.reals()[left], b = column.reals()[right];
+                order = (a > b) - (a < b);
+                break;
+            }
+            default:
+                order = column.texts()[left].compare(column.texts()[right]);
+                break;
+        }
+        if (order != 0) return key.descending ? order > 0 : order < 0;
+    }
+    return left < right;
+}
+
+// The heap serves a keep count only when the source is expected to produce at
+// least this many rows per kept row. It compares column values on one thread
+// and cannot spill, so it pays off only while most rows lose against its top.
+constexpr size_t HEAP_MIN_ROWS_PER_KEPT = 64;
+
+Sort::Sort(std::unique_ptr<BatchSource> input, const std::vector<Column>& tableData, std::vector<SortKey> sortKeys,
+           size_t keepRows, size_t expectedRows)
+    : source(std::move(input)), data(tableData), keys(sortKeys), order(tableData, std::move(sortKeys)), keep(keepRows),
+      heap(keepRows <= expectedRows / HEAP_MIN_ROWS_PER_KEPT && keepRows <= sortMemory() / sizeof(RowId)) {}
+
+Sort::~Sort() = default;
+
+void Sort::describeIn(std::string& text, std::string keyNames) {
+    description = &text;
+    keyList = std::move(keyNames);
+}
+
+void Sort::sortRows() {
+    Batch batch;
+    if (!heap) {
+        sorter = std::make_unique<RowSorter>(data, keys);
+        while (source->next(batch)) sorter->add(batch);
+        sorter->finish();
+        if (description) {
+            *description = std::string(sorter->exactKeys() ? "radix sort" : "merge sort") + " by " + keyList;
+            if (sorter->threadsUsed() > 1) *description += " on " + std::to_string(sorter->threadsUsed()) + " threads";
+            if (sorter->runsSpilled() > 0) {
+                *description += ", merging " + std::to_string(sorter->runsSpilled()) + " sorted run(s) spilled to disk";
+            }
+        }
+        sorted = true;
+        return;
+    }
+    if (description) *description = "top-" + std::to_string(keep) + " heap by " + keyList;
+    if (keep > 0) {
+        // rows is a max-heap of the first keep rows seen so far; its top is the
+        // row any better one replaces
+        while (source->next(batch)) {
+            for (size_t i = 0; i < batch.count; ++i) {
+                RowId row = batch.row(i);
+                if (rows.size() < keep) {
+                    rows.push_back(row);
+                    std::push_heap(rows.begin(), rows.end(), order);
+                } else if (order(row, rows.front())) {
+                    std::pop_heap(rows.begin(), rows.end(), order);
+                    rows.back() = row;
+                    std::push_heap(rows.begin(), rows.end(), order);
+                }
+            }
+        }
+        std::sort_heap(rows.begin(), rows.end(), order);
+    }
+    sorted = true;
+}
+
+bool Sort::next(Batch& batch) {
+    if (!sorted) sortRows();
+    if (sorter) {
+        // Past the first keep rows the sorted runs are not merged any further
+        if (position == keep || !sorter->next(batch)) return false;
+        batch.count = std::min(batch.count, keep - position);
+        position += batch.count;
+        return true;
+    }
+    if (position == rows.size()) return false;
+    size_t count = std::min(BATCH_SIZE, rows.size() - position);
+    std::copy(rows.begin() + position, rows.begin() + position + count, batch.rows.begin());
+    position += count;
+    batch.dense = false;
+    batch.count = count;
+    return true;
+}
+
+namespace {
+
+template <typename T>
+void gather(const std::vector<T>& values, const Batch& batch, std::vector<T>& out) {
+    out.resize(batch.count);
+    if (batch.dense) {
+        std::copy(values.begin() + batch.first, values.begin() + batch.first + batch.count, out.begin());
+        return;
+    }
+    for (size_t i = 0; i < batch.count; ++i) {
+        out[i] = values[batch.rows[i]];
+    }
+}
+
+} // namespace
+
+Projection::Projection(std::unique_ptr<BatchSource> input, const std::vector<Column>& tableData, std::vector<int> outputColumns)
+    : source(std::move(input)), data(tableData), columns(std::move(outputColumns)) {}
+
+bool Projection::next(ColumnBatch& out) {
+    if (!source->next(batch)) return false;
+    if (out.columns.size() != columns.size()) {
+        out.columns.clear();
+        for (int column : columns) out.columns.emplace_back(data[column].type());
+    }
+    for (size_t c = 0; c < columns.size(); ++c) {
+        const Column& input = data[columns[c]];
+        Column& output = out.columns[c];
+        switch (input.type()) {
+            case INT: gather(input.ints(), batch, output.ints()); break;
+            case REAL: gather(input.reals(), batch, output.reals()); break;
+            default: gather(input.texts(), batch, output.texts()); break;
+        }
+    }
+    out.count = batch.count;
+    return true;
+}
@@ -0,0 +1,266 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "column.h"
+#include "predicate.h"
+
+// Batch-at-a-time query execution. Operators hand each other batches of up
+// to BATCH_SIZE rows of one table. A batch names its rows with a selection
+// vector of row ids rather than copying values, so a filter only rewrites the
+// vector, and values are read once, a column at a time, when they are
+// projected. A batch of row ids plus the column values it touches stays in
+// the L1/L2 cache while every operator works on it.
+constexpr size_t BATCH_SIZE = 2048;
+
+// Large scans are split into morsels of MORSEL_ROWS rows that run on the shared
+// thread pool. Tables with fewer than PARALLEL_SCAN_MIN_ROWS rows are scanned
+// on the calling thread, where starting workers would cost more than it saves.
+constexpr size_t MORSEL_ROWS = 64 * 1024;
+constexpr size_t PARALLEL_SCAN_MIN_ROWS = 2 * MORSEL_ROWS;
+
+// Threads a scan may use, the caller included (SET threads = N). 0, the
+// default, uses one per worker of the shared pool.
+void setScanThreads(size_t threads);
+size_t scanThreads();
+// Threads that work on rows rows under the current setting: 1 below the
+// parallel threshold, and never more than there are morsels
+size_t scanThreadsFor(size_t rows);
+
+// Rows of a table still selected by a pipeline
+struct Batch {
+    // While dense, the rows are first .. first + count - 1 and rows is unused
+    bool dense = false;
+    RowId first = 0;
+    size_t count = 0;
+    std::vector<RowId> rows; // Selection vector, BATCH_SIZE long
+
+    Batch() : rows(BATCH_SIZE) {}
+    RowId row(size_t i) const { return dense ? first + static_cast<RowId>(i) : rows[i]; }
+};
+
+// A pipeline stage producing batches in row order
+class BatchSource {
+public:
+    virtual ~BatchSource() = default;
+    // Fills batch with the next non-empty set of rows; returns false once exhausted
+    virtual bool next(Batch& batch) = 0;
+};
+
+// How a statement runs under EXPLAIN: OFF runs it as usual, PLAN plans its
+// pipeline without reading rows, and ANALYZE runs it while every operator
+// counts and times the rows it produces
+enum class ExplainMode {
+    OFF,
+    PLAN,
+    ANALYZE
+};
+
+// One operator of a pipeline as EXPLAIN shows it, with what it did under
+// EXPLAIN ANALYZE
+struct OperatorProfile {
+    std::string name;       // The operator and what it works on, e.g. "Filter: v < 10"
+    size_t bytesPerRow = 0; // Bytes of column values and row ids it reads per input row
+    size_t rowsIn = 0;      // Left 0 by operators that read the rows of the one below
+    size_t rowsOut = 0;
+    double seconds = 0;     // Wall time spent producing its rows, the operators below included
+};
+
+// Bytes a value of the type takes in its column array; TEXT counts the
+// string object, not characters stored outside it
+size_t valueBytes(DataType type);
+
+// Passes the batches of its source through, adding their rows and the time
+// spent producing them to a profile
+class Profiled : public BatchSource {
+public:
+    Profiled(std::unique_ptr<BatchSource> source, OperatorProfile& profile);
+    bool next(Batch& batch) override;
+
+private:
+    std::unique_ptr<BatchSource> source;
+    OperatorProfile& profile;
+};
+
+// Live rows of [begin, end), BATCH_SIZE rows of the table at a time
+class TableScan : public BatchSource {
+public:
+    TableScan(const std::vector<bool>& deleted, size_t deletedCount, size_t begin, size_t end);
+    bool next(Batch& batch) override;
+    // Adds the number of table rows read to counter as the scan advances
+    void countRowsRead(size_t& counter) { rowsRead = &counter; }
+
+private:
+    const std::vector<bool>& deleted;
+    bool anyDeleted;
+    size_t position;
+    size_t end;
+    size_t* rowsRead = nullptr;
+};
+
+// A list of row ids, such as the result of an index lookup, in batches
+class RowListScan : public BatchSource {
+public:
+    explicit RowListScan(std::vector<RowId> rows);
+    bool next(Batch& batch) override;
+
+private:
+    std::vector<RowId> rows;
+    size_t position = 0;
+};
+
+// Drops the rows of each batch that do not satisfy one condition
+class Filter : public BatchSource {
+public:
+    Filter(std::unique_ptr<BatchSource> source, const std::vector<Column>& data, Condition condition);
+    bool next(Batch& batch) override;
+
+private:
+    std::unique_ptr<BatchSource> source;
+    const std::vector<Column>& data;
+    Condition condition;
+};
+
+// Full scan whose morsels are filtered in parallel. Every morsel runs its own
+// TableScan and Filter chain into a private row list; the lists are then
+// handed out in morsel order, so rows still come out in table order.
+class ParallelScan : public BatchSource {
+public:
+    ParallelScan(const std::vector<Column>& data, const std::vector<bool>& deleted, size_t deletedCount, size_t rows,
+                 std::vector<Condition> filters, size_t threads);
+    bool next(Batch& batch) override;
+
+    size_t morselCount() const { return (rows + MORSEL_ROWS - 1) / MORSEL_ROWS; }
+    size_t threadCount() const { return threads; }
+    // Runs the morsels in parallel and hands every batch they produce to
+    // consume(morsel, batch) on the thread that produced it, instead of
+    // collecting row lists. Operators that fold rows into per-morsel state,
+    // such as aggregations, use this in place of next().
+    void forEachBatch(const std::function<void(size_t, const Batch&)>& consume);
+    // Makes next() scan threadCount() morsels at a time, only once the rows of
+    // the previous ones are used up, so a consumer that stops pulling early
+    // (LIMIT) leaves the rest of the table unread
+    void scanIncrementally() { waveMorsels = threads; }
+    // Adds the number of table rows read to counter as morsels are scanned
+    void countRowsRead(size_t& counter) { rowsRead = &counter; }
+    // Adds the rows its morsels read and keep, and the wall time they take, to
+    // profile; it is not wrapped in Profiled, so forEachBatch stays reachable
+    void profileInto(OperatorProfile& stats) { profile = &stats; }
+
+private:
+    const std::vector<Column>& data;
+    const std::vector<bool>& deleted;
+    size_t deletedCount;
+    size_t rows;
+    std::vector<Condition> filters;
+    size_t threads;
+    size_t waveMorsels = std::numeric_limits<size_t>::max();
+    size_t* rowsRead = nullptr;
+    OperatorProfile* profile = nullptr;
+    size_t scannedMorsels = 0;
+    std::vector<std::vector<RowId>> morselRows;
+    size_t morsel = 0;
+    size_t position = 0;
+
+    void runMorsels(size_t begin, size_t end, const std::function<void(size_t, const Batch&)>& consume);
+    void scanNextWave();
+};
+
+// Passed as a row limit when there is none
+constexpr size_t NO_LIMIT = std::numeric_limits<size_t>::max();
+
+// Skips the first offset rows of its source and ends after the next limit
+// rows. It stops pulling from the source once done, so a lazy pipeline below
+// it stops scanning too.
+class Limit : public BatchSource {
+public:
+    Limit(std::unique_ptr<BatchSource> source, size_t limit, size_t offset);
+    bool next(Batch& batch) override;
+
+private:
+    std::unique_ptr<BatchSource> source;
+    size_t remaining;
+    size_t skip;
+};
+
+// One column of an ORDER BY
+struct SortKey {
+    int column;
+    bool descending = false;
+};
+
+// Strict weak order of rows by their values under a list of sort keys. Rows
+// that tie on every key are ordered by row id, so the order is total.
+class RowOrder {
+public:
+    RowOrder(const std::vector<Column>& data, std::vector<SortKey> keys);
+    bool operator()(RowId left, RowId right) const;
+
+private:
+    const std::vector<Column>& data;
+    std::vector<SortKey> keys;
+};
+
+class RowSorter;
+
+// Hands out the rows of its source in sort key order, the first keep of them
+// at most. All rows are read on the first call to next(). When keep is small
+// next to the expectedRows the source should produce, only the first keep
+// rows of the order are kept, in a bounded max-heap, so memory and work stay
+// O(keep) per row rather than sorting everything. Otherwise every row goes
+// through a RowSorter (sort.h), which sorts in parallel and spills to disk.
+class Sort : public BatchSource {
+public:
+    Sort(std::unique_ptr<BatchSource> source, const std::vector<Column>& data, std::vector<SortKey> keys,
+         size_t keep = NO_LIMIT, size_t expectedRows = 0);
+    ~Sort() override;
+    bool next(Batch& batch) override;
+    // Whether the rows are kept in a top-keep heap rather than fully sorted
+    bool usesHeap() const { return heap; }
+    // Once the rows are sorted, sets text to how, e.g. "radix sort by " +
+    // keyNames; keyNames lists the sort keys for display
+    void describeIn(std::string& text, std::string keyNames);
+
+private:
+    std::unique_ptr<BatchSource> source;
+    const std::vector<Column>& data;
+    std::vector<SortKey> keys;
+    RowOrder order;
+    size_t keep;
+    bool heap;
+    bool sorted = false;
+    std::vector<RowId> rows;
+    size_t position = 0; // Rows handed out so far
+    std::unique_ptr<RowSorter> sorter;
+    std::string* description = nullptr;
+    std::string keyList;
+
+    void sortRows();
+};
+
+// Values of the selected rows of one batch, one typed array per output column
+struct ColumnBatch {
+    std::vector<Column> columns;
+    size_t count = 0;
+};
+
+// Reads the output columns of every row a pipeline selects
+class Projection {
+public:
+    Projection(std::unique_ptr<BatchSource> source, const std::vector<Column>& data, std::vector<int> columns);
+    // Fills out with the values of the next batch; returns false once exhausted
+    bool next(ColumnBatch& out);
+
+private:
+    std::unique_ptr<BatchSource> source;
+    const std::vector<Column>& data;
+    std::vector<int> columns;
+    Batch batch;
+};
+
+#endif // EXEC_H
@@ -0,0 +1,367 @@
+#include "filter_kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEXADB_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Calls fn with the operator as a compile-time constant, so each kernel is
+// instantiated once per operator with the comparison fixed in its loop
+template <typename Fn>
+size_t withOp(CompareOp op, Fn&& fn) {
+    switch (op) {
+        case CompareOp::EQ: return fn(std::integral_constant<CompareOp, CompareOp::EQ>());
+        case CompareOp::NE: return fn(std::integral_constant<CompareOp, CompareOp::NE>());
+        case CompareOp::LT: return fn(std::integral_constant<CompareOp, CompareOp::LT>());
+        case CompareOp::LE: return fn(std::integral_constant<CompareOp, CompareOp::LE>());
+        case CompareOp::GT: return fn(std::integral_constant<CompareOp, CompareOp::GT>());
+        case CompareOp::GE: return fn(std::integral_constant<CompareOp, CompareOp::GE>());
+    }
+    return 0;
+}
+
+struct KernelSet {
+    size_t (*int32Range)(const int32_t*, RowId, size_t, CompareOp, int32_t, RowId*);
+    size_t (*doubleRange)(const double*, RowId, size_t, CompareOp, double, RowId*);
+    size_t (*int32Rows)(const int32_t*, const RowId*, size_t, CompareOp, int32_t, RowId*);
+    size_t (*doubleRows)(const double*, const RowId*, size_t, CompareOp, double, RowId*);
+};
+
+size_t int32RangeScalar(const int32_t* values, RowId first, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return scalarFilterRange(values, first, count, op, literal, out);
+}
+size_t doubleRangeScalar(const double* values, RowId first, size_t count, CompareOp op, double literal, RowId* out) {
+    return scalarFilterRange(values, first, count, op, literal, out);
+}
+size_t int32RowsScalar(const int32_t* values, const RowId* rows, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return scalarFilterRows(values, rows, count, op, literal, out);
+}
+size_t doubleRowsScalar(const double* values, const RowId* rows, size_t count, CompareOp op, double literal, RowId* out) {
+    return scalarFilterRows(values, rows, count, op, literal, out);
+}
+
+const KernelSet SCALAR_KERNELS = {int32RangeScalar, doubleRangeScalar, int32RowsScalar, doubleRowsScalar};
+
+#ifdef HEXADB_X86_KERNELS
+
+// Shuffles that move the lanes set in a comparison mask to the front, in order:
+// lanes8 for AVX2 (_mm256_permutevar8x32_epi32 lane numbers), lanes4 for SSE
+// (_mm_shuffle_epi8 byte numbers, 0x80 clears the byte)
+struct CompactTables {
+    alignas(32) uint32_t lanes8[256][8];
+    alignas(16) uint8_t lanes4[16][16];
+
+    CompactTables() {
+        for (unsigned mask = 0; mask < 256; ++mask) {
+            unsigned next = 0;
+            for (unsigned lane = 0; lane < 8; ++lane) {
+                if (mask & (1u << lane)) lanes8[mask][next++] = lane;
+            }
+            while (next < 8) lanes8[mask][next++] = 0;
+        }
+        for (unsigned mask = 0; mask < 16; ++mask) {
+            unsigned next = 0;
+            for (unsigned lane = 0; lane < 4; ++lane) {
+                if (!(mask & (1u << lane))) continue;
+                for (unsigned byte = 0; byte < 4; ++byte) lanes4[mask][next * 4 + byte] = static_cast<uint8_t>(lane * 4 + byte);
+                ++next;
+            }
+            for (unsigned byte = next * 4; byte < 16; ++byte) lanes4[mask][byte] = 0x80;
+        }
+    }
+};
+
+const CompactTables& compactTables() {
+    static const CompactTables tables;
+    return tables;
+}
+
+// NE, LE and GE are computed as the complement of EQ, GT and LT. Doubles use
+// the ordered/unordered predicates that match the scalar operators on NaN.
+constexpr bool complemented(CompareOp op) {
+    return op == CompareOp::NE || op == CompareOp::LE || op == CompareOp::GE;
+}
+
+// ---- SSE4.1: 4 lanes ----
+
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) inline unsigned int32Mask4(__m128i values, __m128i literal) {
+    __m128i hits;
+    if constexpr (OP == CompareOp::EQ || OP == CompareOp::NE) hits = _mm_cmpeq_epi32(values, literal);
+    else if constexpr (OP == CompareOp::GT || OP == CompareOp::LE) hits = _mm_cmpgt_epi32(values, literal);
+    else hits = _mm_cmplt_epi32(values, literal);
+    unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(hits)));
+    return complemented(OP) ? mask ^ 0xF : mask;
+}
+
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) inline unsigned doubleMask2(__m128d values, __m128d literal) {
+    if constexpr (OP == CompareOp::EQ) return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpeq_pd(values, literal)));
+    if constexpr (OP == CompareOp::NE) return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpneq_pd(values, literal)));
+    if constexpr (OP == CompareOp::LT) return static_cast<unsigned>(_mm_movemask_pd(_mm_cmplt_pd(values, literal)));
+    if constexpr (OP == CompareOp::LE) return static_cast<unsigned>(_mm_movemask_pd(_mm_cmple_pd(values, literal)));
+    if constexpr (OP == CompareOp::GT) return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpgt_pd(values, literal)));
+    return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpge_pd(values, literal)));
+}
+
+// Stores the row ids of the lanes set in mask at out and returns how many
+__attribute__((target("sse4.1,popcnt"))) inline size_t compact4(const CompactTables& tables, __m128i ids, unsigned mask, RowId* out) {
+    __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.lanes4[mask]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(ids, shuffle));
+    return static_cast<size_t>(__builtin_popcount(mask));
+}
+
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) size_t int32RangeSse4Op(const int32_t* values, RowId first, size_t count, int32_t literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m128i lit = _mm_set1_epi32(literal);
+    __m128i ids = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(first)), _mm_setr_epi32(0, 1, 2, 3));
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + first + i));
+        selected += compact4(tables, ids, int32Mask4<OP>(v, lit), out + selected);
+        ids = _mm_add_epi32(ids, _mm_set1_epi32(4));
+    }
+    return selected + scalarFilterRange(values, first + static_cast<RowId>(i), count - i, OP, literal, out + selected);
+}
+
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) size_t doubleRangeSse4Op(const double* values, RowId first, size_t count, double literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m128d lit = _mm_set1_pd(literal);
+    __m128i ids = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(first)), _mm_setr_epi32(0, 1, 2, 3));
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const double* v = values + first + i;
+        unsigned mask = doubleMask2<OP>(_mm_loadu_pd(v), lit) | doubleMask2<OP>(_mm_loadu_pd(v + 2), lit) << 2;
+        selected += compact4(tables, ids, mask, out + selected);
+        ids = _mm_add_epi32(ids, _mm_set1_epi32(4));
+    }
+    return selected + scalarFilterRange(values, first + static_cast<RowId>(i), count - i, OP, literal, out + selected);
+}
+
+// SSE has no gather; the lanes are loaded one by one and compared together
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) size_t int32RowsSse4Op(const int32_t* values, const RowId* rows, size_t count, int32_t literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m128i lit = _mm_set1_epi32(literal);
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + i));
+        __m128i v = _mm_setr_epi32(values[rows[i]], values[rows[i + 1]], values[rows[i + 2]], values[rows[i + 3]]);
+        selected += compact4(tables, ids, int32Mask4<OP>(v, lit), out + selected);
+    }
+    return selected + scalarFilterRows(values, rows + i, count - i, OP, literal, out + selected);
+}
+
+template <CompareOp OP>
+__attribute__((target("sse4.1,popcnt"))) size_t doubleRowsSse4Op(const double* values, const RowId* rows, size_t count, double literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m128d lit = _mm_set1_pd(literal);
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + i));
+        __m128d low = _mm_setr_pd(values[rows[i]], values[rows[i + 1]]);
+        __m128d high = _mm_setr_pd(values[rows[i + 2]], values[rows[i + 3]]);
+        unsigned mask = doubleMask2<OP>(low, lit) | doubleMask2<OP>(high, lit) << 2;
+        selected += compact4(tables, ids, mask, out + selected);
+    }
+    return selected + scalarFilterRows(values, rows + i, count - i, OP, literal, out + selected);
+}
+
+// ---- AVX2: 8 lanes ----
+
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) inline unsigned int32Mask8(__m256i values, __m256i literal) {
+    __m256i hits;
+    if constexpr (OP == CompareOp::EQ || OP == CompareOp::NE) hits = _mm256_cmpeq_epi32(values, literal);
+    else if constexpr (OP == CompareOp::GT || OP == CompareOp::LE) hits = _mm256_cmpgt_epi32(values, literal);
+    else hits = _mm256_cmpgt_epi32(literal, values);
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(hits)));
+    return complemented(OP) ? mask ^ 0xFF : mask;
+}
+
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) inline unsigned doubleMask4(__m256d values, __m256d literal) {
+    if constexpr (OP == CompareOp::EQ) return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_EQ_OQ)));
+    if constexpr (OP == CompareOp::NE) return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_NEQ_UQ)));
+    if constexpr (OP == CompareOp::LT) return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_LT_OQ)));
+    if constexpr (OP == CompareOp::LE) return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_LE_OQ)));
+    if constexpr (OP == CompareOp::GT) return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_GT_OQ)));
+    return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(values, literal, _CMP_GE_OQ)));
+}
+
+__attribute__((target("avx2,popcnt"))) inline size_t compact8(const CompactTables& tables, __m256i ids, unsigned mask, RowId* out) {
+    __m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i*>(tables.lanes8[mask]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permutevar8x32_epi32(ids, lanes));
+    return static_cast<size_t>(__builtin_popcount(mask));
+}
+
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) size_t int32RangeAvx2Op(const int32_t* values, RowId first, size_t count, int32_t literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m256i lit = _mm256_set1_epi32(literal);
+    __m256i ids = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + first + i));
+        selected += compact8(tables, ids, int32Mask8<OP>(v, lit), out + selected);
+        ids = _mm256_add_epi32(ids, _mm256_set1_epi32(8));
+    }
+    return selected + scalarFilterRange(values, first + static_cast<RowId>(i), count - i, OP, literal, out + selected);
+}
+
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) size_t doubleRangeAvx2Op(const double* values, RowId first, size_t count, double literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m256d lit = _mm256_set1_pd(literal);
+    __m256i ids = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const double* v = values + first + i;
+        unsigned mask = doubleMask4<OP>(_mm256_loadu_pd(v), lit) | doubleMask4<OP>(_mm256_loadu_pd(v + 4), lit) << 4;
+        selected += compact8(tables, ids, mask, out + selected);
+        ids = _mm256_add_epi32(ids, _mm256_set1_epi32(8));
+    }
+    return selected + scalarFilterRange(values, first + static_cast<RowId>(i), count - i, OP, literal, out + selected);
+}
+
+// Row ids index the gathers directly; tables stay well below 2^31 rows
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) size_t int32RowsAvx2Op(const int32_t* values, const RowId* rows, size_t count, int32_t literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m256i lit = _mm256_set1_epi32(literal);
+    const int* base = reinterpret_cast<const int*>(values);
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+        __m256i v = _mm256_i32gather_epi32(base, ids, 4);
+        selected += compact8(tables, ids, int32Mask8<OP>(v, lit), out + selected);
+    }
+    return selected + scalarFilterRows(values, rows + i, count - i, OP, literal, out + selected);
+}
+
+template <CompareOp OP>
+__attribute__((target("avx2,popcnt"))) size_t doubleRowsAvx2Op(const double* values, const RowId* rows, size_t count, double literal, RowId* out) {
+    const CompactTables& tables = compactTables();
+    const __m256d lit = _mm256_set1_pd(literal);
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    size_t selected = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+        __m256d low = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values, _mm256_castsi256_si128(ids), all, 8);
+        __m256d high = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values, _mm256_extracti128_si256(ids, 1), all, 8);
+        unsigned mask = doubleMask4<OP>(low, lit) | doubleMask4<OP>(high, lit) << 4;
+        selected += compact8(tables, ids, mask, out + selected);
+    }
+    return selected + scalarFilterRows(values, rows + i, count - i, OP, literal, out + selected);
+}
+
+size_t int32RangeSse4(const int32_t* values, RowId first, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return withOp(op, [&](auto o) { return int32RangeSse4Op<decltype(o)::value>(values, first, count, literal, out); });
+}
+size_t doubleRangeSse4(const double* values, RowId first, size_t count, CompareOp op, double literal, RowId* out) {
+    return withOp(op, [&](auto o) { return doubleRangeSse4Op<decltype(o)::value>(values, first, count, literal, out); });
+}
+size_t int32RowsSse4(const int32_t* values, const RowId* rows, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return withOp(op, [&](auto o) { return int32RowsSse4Op<decltype(o)::value>(values, rows, count, literal, out); });
+}
+size_t doubleRowsSse4(const double* values, const RowId* rows, size_t count, CompareOp op, double literal, RowId* out) {
+    return withOp(op, [&](auto o) { return doubleRowsSse4Op<decltype(o)::value>(values, rows, count, literal, out); });
+}
+size_t int32RangeAvx2(const int32_t* values, RowId first, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return withOp(op, [&](auto o) { return int32RangeAvx2Op<decltype(o)::value>(values, first, count, literal, out); });
+}
+size_t doubleRangeAvx2(const double* values, RowId first, size_t count, CompareOp op, double literal, RowId* out) {
+    return withOp(op, [&](auto o) { return doubleRangeAvx2Op<decltype(o)::value>(values, first, count, literal, out); });
+}
+size_t int32RowsAvx2(const int32_t* values, const RowId* rows, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return withOp(op, [&](auto o) { return int32RowsAvx2Op<decltype(o)::value>(values, rows, count, literal, out); });
+}
+size_t doubleRowsAvx2(const double* values, const RowId* rows, size_t count, CompareOp op, double literal, RowId* out) {
+    return withOp(op, [&](auto o) { return doubleRowsAvx2Op<decltype(o)::value>(values, rows, count, literal, out); });
+}
+
+const KernelSet SSE4_KERNELS = {int32RangeSse4, doubleRangeSse4, int32RowsSse4, doubleRowsSse4};
+const KernelSet AVX2_KERNELS = {int32RangeAvx2, doubleRangeAvx2, int32RowsAvx2, doubleRowsAvx2};
+
+#endif // HEXADB_X86_KERNELS
+
+const KernelSet* kernelsFor(SimdLevel level) {
+#ifdef HEXADB_X86_KERNELS
+    if (level == SimdLevel::AVX2) return &AVX2_KERNELS;
+    if (level == SimdLevel::SSE4) return &SSE4_KERNELS;
+#endif
+    (void)level;
+    return &SCALAR_KERNELS;
+}
+
+std::atomic<SimdLevel>& levelSetting() {
+    static std::atomic<SimdLevel> level{supportedSimdLevel()};
+    return level;
+}
+
+const KernelSet& kernels() {
+    return *kernelsFor(levelSetting().load(std::memory_order_relaxed));
+}
+
+} // namespace
+
+SimdLevel supportedSimdLevel() {
+#ifdef HEXADB_X86_KERNELS
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt")) return SimdLevel::SSE4;
+        return SimdLevel::SCALAR;
+    }();
+    return level;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+SimdLevel activeSimdLevel() {
+    return levelSetting().load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(SimdLevel level) {
+    levelSetting().store(std::min(level, supportedSimdLevel()), std::memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE4: return "SSE4.1";
+        default: return "scalar";
+    }
+}
+
+size_t filterRange(const int32_t* values, RowId first, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return kernels().int32Range(values, first, count, op, literal, out);
+}
+
+size_t filterRange(const double* values, RowId first, size_t count, CompareOp op, double literal, RowId* out) {
+    return kernels().doubleRange(values, first, count, op, literal, out);
+}
+
+size_t filterRows(const int32_t* values, const RowId* rows, size_t count, CompareOp op, int32_t literal, RowId* out) {
+    return kernels().int32Rows(values, rows, count, op, literal, out);
+}
+
+size_t filterRows(const double* values, const RowId* rows, size_t count, CompareOp op, double literal, RowId* out) {
+    return kernels().doubleRows(values, rows, count, op, literal, out);
+}
@@ -0,0 +1,88 @@
+#ifndef FILTER_KERNELS_H
+#define FILTER_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "index.h"
+
+// Comparison kernels behind WHERE filters. Each one writes the rows whose
+// value satisfies "value op literal" to out, in order, and returns how many
+// there are. The Range kernels test rows first .. first + count - 1, the Rows
+// kernels test the rows listed in rows[0 .. count). out needs room for count
+// rows and may be rows itself.
+//
+// INT and REAL kernels come in AVX2, SSE4.1 and scalar versions; the best one
+// the CPU supports is picked on first use. The vector versions compare 8 (AVX2)
+// or 4 (SSE4.1) values at once and pack the row ids of the matching lanes with
+// one shuffle through a table indexed by the comparison mask.
+enum class SimdLevel {
+    SCALAR,
+    SSE4,
+    AVX2
+};
+
+// Best level this CPU supports, from CPUID
+SimdLevel supportedSimdLevel();
+SimdLevel activeSimdLevel();
+// Switches the kernels to level, or to the best supported level below it
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+size_t filterRange(const int32_t* values, RowId first, size_t count, CompareOp op, int32_t literal, RowId* out);
+size_t filterRange(const double* values, RowId first, size_t count, CompareOp op, double literal, RowId* out);
+size_t filterRows(const int32_t* values, const RowId* rows, size_t count, CompareOp op, int32_t literal, RowId* out);
+size_t filterRows(const double* values, const RowId* rows, size_t count, CompareOp op, double literal, RowId* out);
+
+// Portable kernels for any comparable type. Every candidate is written to out
+// and the count only advances past the ones that match, so the loops carry no
+// data-dependent branch.
+template <typename T, typename Cmp>
+size_t scalarFilterRange(const T* values, RowId first, size_t count, const T& literal, Cmp cmp, RowId* out) {
+    size_t selected = 0;
+    for (size_t i = 0; i < count; ++i) {
+        RowId row = first + static_cast<RowId>(i);
+        out[selected] = row;
+        selected += cmp(values[row], literal);
+    }
+    return selected;
+}
+
+template <typename T, typename Cmp>
+size_t scalarFilterRows(const T* values, const RowId* rows, size_t count, const T& literal, Cmp cmp, RowId* out) {
+    size_t selected = 0;
+    for (size_t i = 0; i < count; ++i) {
+        RowId row = rows[i];
+        out[selected] = row;
+        selected += cmp(values[row], literal);
+    }
+    return selected;
+}
+
+template <typename T>
+size_t scalarFilterRange(const T* values, RowId first, size_t count, CompareOp op, const T& literal, RowId* out) {
+    switch (op) {
+        case CompareOp::EQ: return scalarFilterRange(values, first, count, literal, std::equal_to<T>(), out);
+        case CompareOp::NE: return scalarFilterRange(values, first, count, literal, std::not_equal_to<T>(), out);
+        case CompareOp::LT: return scalarFilterRange(values, first, count, literal, std::less<T>(), out);
+        case CompareOp::LE: return scalarFilterRange(values, first, count, literal, std::less_equal<T>(), out);
+        case CompareOp::GT: return scalarFilterRange(values, first, count, literal, std::greater<T>(), out);
+        case CompareOp::GE: return scalarFilterRange(values, first, count, literal, std::greater_equal<T>(), out);
+    }
+    return 0;
+}
+
+template <typename T>
+size_t scalarFilterRows(const T* values, const RowId* rows, size_t count, CompareOp op, const T& literal, RowId* out) {
+    switch (op) {
+        case CompareOp::EQ: return scalarFilterRows(values, rows, count, literal, std::equal_to<T>(), out);
+        case CompareOp::NE: return scalarFilterRows(values, rows, count, literal, std::not_equal_to<T>(), out);
+        case CompareOp::LT: return scalarFilterRows(values, rows, count, literal, std::less<T>(), out);
+        case CompareOp::LE: return scalarFilterRows(values, rows, count, literal, std::less_equal<T>(), out);
+        case CompareOp::GT: return scalarFilterRows(values, rows, count, literal, std::greater<T>(), out);
+        case CompareOp::GE: return scalarFilterRows(values, rows, count, literal, std::greater_equal<T>(), out);
+    }
+    return 0;
+}
+
+#endif // FILTER_KERNELS_H
@@ -0,0 +1,319 @@
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "btree.h"
+
+// Hash of an index key, spread over all 64 bits
+inline uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t hashKey(int32_t key) { return mixHash(static_cast<uint32_t>(key)); }
+inline uint64_t hashKey(const std::string& key) { return mixHash(std::hash<std::string>()(key)); }
+inline uint64_t hashKey(double key) {
+    if (key == 0.0) key = 0.0; // -0.0 == 0.0, so both must hash alike
+    uint64_t bits;
+    std::memcpy(&bits, &key, sizeof(bits));
+    return mixHash(bits);
+}
+
+// Open-addressing multimap from keys to row ids, laid out like a Swiss table.
+// Slots are split into groups of 16 with one control byte each: EMPTY,
+// DELETED, or the low 7 bits of the key's hash. A probe compares a whole
+// group of control bytes against those 7 bits at once (one SSE2 compare), so
+// only slots that are almost certainly a match have their key compared.
+//
+// Each slot holds its key and where its rows are. A key with a single row
+// keeps it inline in the slot, so a lookup on a unique key touches only the
+// control group and the slot. Keys with more rows keep them back to back in
+// one shared arena; a list that outgrows its space moves to the end of the
+// arena, and the arena is compacted once half of it is abandoned space.
+template <typename Key>
+class FlatHashMultimap {
+    static constexpr size_t GROUP = 16;
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    struct Slot {
+        Key key{};
+        uint32_t count = 0;     // Rows stored under key
+        uint32_t capacity = 0;  // Arena space reserved; 0 while the single row is kept inline
+        uint32_t offset = 0;    // Arena position, or the row itself when capacity is 0
+    };
+
+public:
+    // Rows stored under one key, valid until the map is next modified
+    struct Rows {
+        const RowId* data = nullptr;
+        size_t count = 0;
+        const RowId* begin() const { return data; }
+        const RowId* end() const { return data + count; }
+    };
+
+    size_t size() const { return entries; }
+    size_t keyCount() const { return keys; }
+
+    void clear() {
+        control.clear();
+        slots.clear();
+        arena.clear();
+        keys = entries = used = garbage = 0;
+    }
+
+    Rows find(const Key& key) const {
+        size_t slot = findSlot(key, hashKey(key));
+        if (slot == NOT_FOUND) return Rows();
+        const Slot& s = slots[slot];
+        return Rows{rowsOf(s), s.count};
+    }
+
+    void insert(const Key& key, RowId row) {
+        appendRow(slotFor(key), row);
+        ++entries;
+    }
+
+    bool erase(const Key& key, RowId row) {
+        size_t slot = findSlot(key, hashKey(key));
+        if (slot == NOT_FOUND) return false;
+        Slot& s = slots[slot];
+        RowId* rows = rowsOf(s);
+        size_t pos = 0;
+        while (pos < s.count && rows[pos] != row) ++pos;
+        if (pos == s.count) return false;
+        rows[pos] = rows[s.count - 1];
+        --s.count;
+        --entries;
+        if (s.count == 0) removeSlot(slot);
+        return true;
+    }
+
+    // Replaces the contents with every value not marked in skip, keyed by its
+    // position. Counts rows per key first so each list is placed exactly once.
+    void build(const std::vector<Key>& values, const std::vector<bool>& skip) {
+        clear();
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (!skip[i]) ++slots[slotFor(values[i])].count;
+        }
+        uint32_t arenaSize = 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            Slot& s = slots[i];
+            if (control[i] < 0 || s.count < 2) continue;
+            s.offset = arenaSize;
+            s.capacity = s.count;
+            arenaSize += s.count;
+        }
+        arena.resize(arenaSize);
+        for (auto& s : slots) s.count = 0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (skip[i]) continue;
+            Slot& s = slots[findSlot(values[i], hashKey(values[i]))];
+            rowsOf(s)[s.count++] = static_cast<RowId>(i);
+            ++entries;
+        }
+    }
+
+    // Renumbers every row through newRowIds, dropping rows mapped to removed
+    void renumber(const std::vector<RowId>& newRowIds, RowId removed) {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (control[i] < 0) continue;
+            Slot& s = slots[i];
+            RowId* rows = rowsOf(s);
+            size_t kept = 0;
+            for (size_t r = 0; r < s.count; ++r) {
+                RowId newRow = newRowIds[rows[r]];
+                if (newRow != removed) rows[kept++] = newRow;
+            }
+            entries -= s.count - kept;
+            s.count = static_cast<uint32_t>(kept);
+            if (kept == 0) removeSlot(i);
+        }
+    }
+
+private:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    std::vector<int8_t> control;
+    std::vector<Slot> slots;
+    std::vector<RowId> arena;
+    size_t keys = 0;     // Full slots
+    size_t entries = 0;  // (key, row) pairs
+    size_t used = 0;     // Full plus deleted slots; bounds probe lengths
+    size_t garbage = 0;  // Arena space no list owns any more
+
+    static int8_t tag(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+    // Bit i is set when control byte i of the group equals value
+    static uint32_t match(const int8_t* group, int8_t value) {
+#ifdef __SSE2__
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i) {
+            if (group[i] == value) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    // EMPTY and DELETED are the only negative control bytes
+    static uint32_t matchFree(const int8_t* group) {
+#ifdef __SSE2__
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i) {
+            if (group[i] < 0) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    size_t groupCount() const { return control.size() / GROUP; }
+
+    const RowId* rowsOf(const Slot& s) const { return s.capacity == 0 ? &s.offset : arena.data() + s.offset; }
+    RowId* rowsOf(Slot& s) { return s.capacity == 0 ? &s.offset : arena.data() + s.offset; }
+
+    size_t findSlot(const Key& key, uint64_t hash) const {
+        if (control.empty()) return NOT_FOUND;
+        size_t mask = groupCount() - 1;
+        size_t group = (hash >> 7) & mask;
+        // Triangular probing visits every group once when the group count is a power of two
+        for (size_t step = 1; step <= groupCount(); ++step) {
+            const int8_t* bytes = control.data() + group * GROUP;
+            for (uint32_t hits = match(bytes, tag(hash)); hits; hits &= hits - 1) {
+                size_t slot = group * GROUP + __builtin_ctz(hits);
+                if (slots[slot].key == key) return slot;
+            }
+            if (match(bytes, EMPTY)) return NOT_FOUND;
+            group = (group + step) & mask;
+        }
+        return NOT_FOUND;
+    }
+
+    // First free slot on the probe path of hash; the table must have one
+    size_t freeSlot(uint64_t hash) const {
+        size_t mask = groupCount() - 1;
+        size_t group = (hash >> 7) & mask;
+        for (size_t step = 1;; ++step) {
+            uint32_t free = matchFree(control.data() + group * GROUP);
+            if (free) return group * GROUP + __builtin_ctz(free);
+            group = (group + step) & mask;
+        }
+    }
+
+    // Slot holding key, claiming a free one if the key is new
+    size_t slotFor(const Key& key) {
+        uint64_t hash = hashKey(key);
+        size_t slot = findSlot(key, hash);
+        if (slot != NOT_FOUND) return slot;
+
+        // Keep at most 7/8 of the slots in use so probes stay short
+        if ((used + 1) * 8 > control.size() * 7) {
+            size_t capacity = GROUP;
+            while ((keys + 1) * 16 > capacity * 7) capacity *= 2;
+            rehash(capacity);
+        }
+        slot = freeSlot(hash);
+        if (control[slot] == EMPTY) ++used;
+        control[slot] = tag(hash);
+        slots[slot] = Slot();
+        slots[slot].key = key;
+        ++keys;
+        return slot;
+    }
+
+    void appendRow(size_t slot, RowId row) {
+        Slot& s = slots[slot];
+        if (s.capacity == 0 && s.count == 0) {
+            s.offset = row;
+            s.count = 1;
+            return;
+        }
+        if (s.capacity == 0 || s.count == s.capacity) {
+            uint32_t newCapacity = s.capacity == 0 ? 4 : s.capacity * 2;
+            if (s.capacity > 0 && s.offset + s.capacity == arena.size()) {
+                arena.resize(s.offset + newCapacity); // Last list in the arena grows in place
+            } else {
+                uint32_t newOffset = static_cast<uint32_t>(arena.size());
+                arena.resize(newOffset + newCapacity);
+                if (s.capacity == 0) {
+                    arena[newOffset] = s.offset; // The inline row
+                } else {
+                    std::copy(arena.begin() + s.offset, arena.begin() + s.offset + s.count, arena.begin() + newOffset);
+                    garbage += s.capacity;
+                }
+                s.offset = newOffset;
+            }
+            s.capacity = newCapacity;
+        }
+        arena[s.offset + s.count++] = row;
+        if (garbage * 2 > arena.size()) compactArena();
+    }
+
+    void removeSlot(size_t slot) {
+        Slot& s = slots[slot];
+        garbage += s.capacity;
+        s = Slot();
+        // A group that still has an EMPTY byte never sent a probe onwards, so the
+        // slot can become EMPTY again instead of a tombstone
+        size_t group = slot / GROUP;
+        if (match(control.data() + group * GROUP, EMPTY)) {
+            control[slot] = EMPTY;
+            --used;
+        } else {
+            control[slot] = DELETED;
+        }
+        --keys;
+    }
+
+    // Copies every list into a fresh arena with no gaps
+    void compactArena() {
+        std::vector<RowId> packed;
+        packed.reserve(arena.size() - garbage);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            Slot& s = slots[i];
+            if (control[i] < 0 || s.capacity == 0) continue;
+            uint32_t offset = static_cast<uint32_t>(packed.size());
+            packed.insert(packed.end(), arena.begin() + s.offset, arena.begin() + s.offset + s.count);
+            s.offset = offset;
+            s.capacity = s.count;
+        }
+        arena.swap(packed);
+        garbage = 0;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<int8_t> oldControl(capacity, EMPTY);
+        std::vector<Slot> oldSlots(capacity);
+        oldControl.swap(control);
+        oldSlots.swap(slots);
+        used = keys;
+        for (size_t i = 0; i < oldSlots.size(); ++i) {
+            if (oldControl[i] < 0) continue;
+            uint64_t hash = hashKey(oldSlots[i].key);
+            size_t slot = freeSlot(hash);
+            control[slot] = tag(hash);
+            slots[slot] = std::move(oldSlots[i]);
+        }
+        if (garbage > 0) compactArena();
+    }
+};
+
+#endif // HASH_TABLE_H
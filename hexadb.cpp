@@ -1,5 +1,13 @@
 // j.sutradhar@symbola.io
 #include "hexadb.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "sort.h"
+#include "thread_pool.h"
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <unistd.h>
 
 // Color constants definitions
 namespace Colors {
@@ -34,6 +42,29 @@ Table::Table(std::string tableName) : name(tableName) {}
 
 void Table::addColumn(const ColumnDefinition& colDef) {
     columns.push_back(colDef);
+    columnData.emplace_back(colDef.dataType);
+    columnData.back().resize(rowCount());
+}
+
+size_t Table::rowCount() const {
+    return columnData.empty() ? 0 : columnData[0].size();
+}
+
+size_t Table::liveRowCount() const {
+    return rowCount() - deletedCount;
+}
+
+Value Table::getValue(size_t row, size_t col) const {
+    return columnData[col].get(row);
+}
+
+std::vector<Value> Table::getRow(size_t row) const {
+    std::vector<Value> rowValues;
+    rowValues.reserve(columnData.size());
+    for (const auto& column : columnData) {
+        rowValues.push_back(column.get(row));
+    }
+    return rowValues;
 }
 
 void Table::insertRow(const std::vector<Value>& rowValues) {
@@ -41,36 +72,514 @@ void Table::insertRow(const std::vector<Value>& rowValues) {
         throw std::runtime_error("Number of values (" + std::to_string(rowValues.size()) + 
                                  ") doesn't match column count (" + std::to_string(columns.size()) + ").");
     }
-    rows.push_back(rowValues);
-    int rowIndex = rows.size() - 1;
+    size_t rowIndex = rowCount();
+    try {
+        for (size_t c = 0; c < columnData.size(); ++c) {
+            columnData[c].append(rowValues[c]);
+        }
+    } catch (const std::runtime_error&) {
+        // Roll back the columns that already accepted a value
+        for (auto& column : columnData) {
+            column.resize(rowIndex);
+        }
+        throw std::runtime_error("Value types don't match the column types of table '" + name + "'.");
+    }
+    deleted.push_back(false);
+
+    for (auto& [indexName, index] : indexes) {
+        index->insert(columnData, static_cast<RowId>(rowIndex));
+    }
+}
+
+void Table::createIndex(const std::string& indexName, const std::vector<std::string>& columnNames, const std::string& kind) {
+    if (indexes.count(indexName)) {
+        throw std::runtime_error("Index '" + indexName + "' already exists on table '" + name + "'.");
+    }
+    std::vector<int> keyColumns;
+    std::vector<DataType> keyTypes;
+    std::string keyList;
+    for (const auto& columnName : columnNames) {
+        int colIndex = getColumnIndex(columnName);
+        if (colIndex == -1) {
+            throw std::runtime_error("Column '" + columnName + "' not found for index creation in table '" + name + "'.");
+        }
+        if (std::find(keyColumns.begin(), keyColumns.end(), colIndex) != keyColumns.end()) {
+            throw std::runtime_error("Column '" + columns[colIndex].name + "' appears twice in index '" + indexName + "'.");
+        }
+        keyColumns.push_back(colIndex);
+        keyTypes.push_back(columns[colIndex].dataType);
+        keyList += (keyList.empty() ? "" : ", ") + columns[colIndex].name;
+    }
+
+    std::unique_ptr<Index> index = makeIndex(kind, keyColumns, keyTypes);
+    index->build(columnData, deleted);
+    indexes[indexName] = std::move(index);
+    std::cout << kind << " index '" << indexName << "' created on (" << keyList << ") for table '" << name << "'" << std::endl;
+}
+
+// Whether clause[i] can border a keyword: whitespace, a parenthesis or either end
+static bool isKeywordBoundary(const std::string& clause, size_t i) {
+    if (i >= clause.size()) return true;
+    unsigned char c = static_cast<unsigned char>(clause[i]);
+    return std::isspace(c) || c == '(' || c == ')';
+}
+
+// Splits a WHERE clause on a keyword ("and" or "or") that is outside quoted
+// literals and parentheses
+static std::vector<std::string> splitTopLevel(const std::string& clause, const std::string& keyword) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    bool quoted = false;
+    int depth = 0;
+    for (size_t i = 0; i < clause.size(); ++i) {
+        if (clause[i] == '\'') {
+            quoted = !quoted;
+        } else if (quoted) {
+            continue;
+        } else if (clause[i] == '(') {
+            ++depth;
+        } else if (clause[i] == ')') {
+            if (--depth < 0) throw std::runtime_error("Unbalanced ')' in WHERE clause.");
+        } else if (depth == 0 && i > 0 && i + keyword.size() <= clause.size() &&
+                   isKeywordBoundary(clause, i - 1) && isKeywordBoundary(clause, i + keyword.size())) {
+            bool match = true;
+            for (size_t k = 0; k < keyword.size() && match; ++k) {
+                match = std::tolower(static_cast<unsigned char>(clause[i + k])) == keyword[k];
+            }
+            if (match) {
+                parts.push_back(clause.substr(start, i - start));
+                start = i + keyword.size();
+                i += keyword.size() - 1;
+            }
+        }
+    }
+    if (depth != 0) throw std::runtime_error("Unbalanced '(' in WHERE clause.");
+    parts.push_back(clause.substr(start));
+    return parts;
+}
+
+// Whether the whole clause is one parenthesized group, as in "(a = 1 OR b = 2)"
+static bool isParenthesized(const std::string& clause) {
+    if (clause.size() < 2 || clause.front() != '(' || clause.back() != ')') return false;
+    bool quoted = false;
+    int depth = 0;
+    for (size_t i = 0; i + 1 < clause.size(); ++i) {
+        if (clause[i] == '\'') quoted = !quoted;
+        if (quoted) continue;
+        if (clause[i] == '(') ++depth;
+        if (clause[i] == ')' && --depth == 0) return false; // Closes before the end
+    }
+    return true;
+}
+
+Condition Table::compileWhere(const std::string& whereClause) const {
+    if (trim(whereClause).empty()) {
+        return Condition();
+    }
+    return compileCondition(whereClause);
+}
 
-    for (const auto& indexPair : indexes) {
-        const std::string& colName = indexPair.first;
-        int colIndex = getColumnIndex(colName);
-        if (colIndex != -1) {
-            indexes[colName][rowValues[colIndex]].push_back(rowIndex);
+Condition Table::planWhere(const std::string& whereClause) const {
+    Condition where = compileWhere(whereClause);
+    where.optimize(columnData, sampleRows());
+    return where;
+}
+
+// OR binds looser than AND; nested groups of the same kind are flattened
+Condition Table::compileCondition(const std::string& text) const {
+    std::string clause = trim(text);
+    if (clause.empty()) {
+        throw std::runtime_error("Empty condition in WHERE clause.");
+    }
+    for (Condition::Kind kind : {Condition::OR, Condition::AND}) {
+        std::vector<std::string> parts = splitTopLevel(clause, kind == Condition::OR ? "or" : "and");
+        if (parts.size() == 1) continue;
+        Condition node;
+        node.kind = kind;
+        for (const auto& part : parts) {
+            Condition child = compileCondition(part);
+            if (child.kind == kind) {
+                for (auto& grandchild : child.children) node.children.push_back(std::move(grandchild));
+            } else {
+                node.children.push_back(std::move(child));
+            }
         }
+        return node;
+    }
+    if (isParenthesized(clause)) {
+        return compileCondition(clause.substr(1, clause.size() - 2));
     }
+    Condition leaf;
+    leaf.kind = Condition::COMPARE;
+    leaf.predicate = compileComparison(clause);
+    return leaf;
 }
 
-void Table::createIndex(const std::string& columnName) {
-    int colIndex = getColumnIndex(columnName);
-    if (colIndex == -1) {
-        throw std::runtime_error("Column '" + columnName + "' not found for index creation in table '" + name + "'.");
+Predicate Table::compileComparison(const std::string& clause) const {
+    size_t opStart = clause.find_first_of("=!<>");
+    size_t opEnd = opStart == std::string::npos ? std::string::npos : clause.find_first_not_of("=!<>", opStart);
+    if (opStart == std::string::npos || opEnd == std::string::npos) {
+        throw std::runtime_error("Invalid WHERE clause '" + clause + "'. Expected: column operator value [AND|OR ...]");
+    }
+    std::string whereColName = trim(clause.substr(0, opStart));
+    std::string whereValueStr = trim(clause.substr(opEnd));
+
+    Predicate predicate;
+    predicate.column = getColumnIndex(whereColName);
+    if (predicate.column == -1) {
+        throw std::runtime_error("Column '" + whereColName + "' in WHERE clause not found in table '" + name + "'.");
+    }
+    predicate.columnName = columns[predicate.column].name;
+    predicate.type = columns[predicate.column].dataType;
+    predicate.op = parseCompareOp(clause.substr(opStart, opEnd - opStart));
+    try {
+        predicate.literal = parseLiteral(predicate.type, whereValueStr);
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Invalid value '" + whereValueStr + "' in WHERE clause: " + e.what());
+    }
+    switch (predicate.type) {
+        case INT: predicate.intLiteral = std::get<int>(predicate.literal); break;
+        case REAL: predicate.realLiteral = std::get<double>(predicate.literal); break;
+        default: predicate.textLiteral = std::get<std::string>(predicate.literal); break;
     }
-    if (indexes.count(columnName)) {
-        return; // Index already exists
+    return predicate;
+}
+
+std::vector<RowId> Table::sampleRows() const {
+    std::vector<RowId> sample;
+    size_t numRows = rowCount();
+    size_t step = std::max<size_t>(1, numRows / SELECTIVITY_SAMPLE_ROWS);
+    for (size_t row = 0; row < numRows && sample.size() < SELECTIVITY_SAMPLE_ROWS; row += step) {
+        if (!deleted[row]) sample.push_back(static_cast<RowId>(row));
     }
+    return sample;
+}
+
+// An index only drives the scan when the conditions it answers are expected to
+// keep at most this fraction of the rows; beyond it, fetching and sorting the
+// row ids costs more than a sequential scan with SIMD filters
+constexpr double INDEX_MAX_SELECTIVITY = 0.25;
 
-    indexes[columnName] = {};
-    for (int i = 0; i < rows.size(); ++i) {
-        indexes[columnName][rows[i][colIndex]].push_back(i);
+static void collectColumns(const Condition& condition, std::vector<bool>& used) {
+    if (condition.kind == Condition::COMPARE) used[condition.predicate.column] = true;
+    for (const Condition& child : condition.children) collectColumns(child, used);
+}
+
+// Bytes of column values a condition reads for one row, every column once
+static size_t conditionBytes(const Condition& condition, const std::vector<Column>& data) {
+    std::vector<bool> used(data.size(), false);
+    collectColumns(condition, used);
+    size_t bytes = 0;
+    for (size_t c = 0; c < data.size(); ++c) {
+        if (used[c]) bytes += valueBytes(data[c].type());
     }
-    std::cout << "Index created on column '" << columnName << "' for table '" << name << "'" << std::endl;
+    return bytes;
+}
+
+std::unique_ptr<BatchSource> Table::addStage(std::unique_ptr<BatchSource> stage, std::string stageName, size_t bytesPerRow) {
+    OperatorProfile profile;
+    profile.name = std::move(stageName);
+    profile.bytesPerRow = bytesPerRow;
+    lastScan.operators.push_back(std::move(profile));
+    if (explain != ExplainMode::ANALYZE) return stage;
+    return std::make_unique<Profiled>(std::move(stage), lastScan.operators.back());
+}
+
+std::unique_ptr<BatchSource> Table::planScan(Condition where, bool foldsRows, bool stopsEarly) {
+    size_t numRows = rowCount();
+    lastScan = ScanInfo();
+
+    // The top-level AND terms, most selective and cheapest first. Only plain
+    // comparisons among them can be answered by an index; OR groups are filters.
+    std::vector<RowId> sample = sampleRows();
+    where.optimize(columnData, sample);
+    lastScan.rowsExpected = static_cast<size_t>(liveRowCount() * where.selectivity);
+    std::vector<Condition> conjuncts;
+    if (where.kind == Condition::AND) {
+        conjuncts = std::move(where.children);
+    } else {
+        conjuncts.push_back(std::move(where));
+    }
+    auto comparable = [&](size_t c, int keyColumn) {
+        return conjuncts[c].kind == Condition::COMPARE && conjuncts[c].predicate.column == keyColumn;
+    };
+
+    // Pick the index whose conjuncts are expected to keep the fewest rows:
+    // equality on a prefix of its key columns, then every range on the next
+    // key column, merged into one window
+    const Index* bestIndex = nullptr;
+    std::string bestName;
+    IndexProbe bestProbe;
+    std::vector<bool> bestUsed;
+    double bestSelectivity = INDEX_MAX_SELECTIVITY;
+    for (const auto& [indexName, index] : indexes) {
+        IndexProbe probe;
+        std::vector<bool> used(conjuncts.size(), false);
+        double selectivity = 1.0;
+        bool any = false;
+        for (int keyColumn : index->keyColumns()) {
+            size_t eq = 0;
+            while (eq < conjuncts.size() && (used[eq] || !comparable(eq, keyColumn) || conjuncts[eq].predicate.op != CompareOp::EQ)) ++eq;
+            if (eq < conjuncts.size()) {
+                probe.equal.push_back(conjuncts[eq].predicate.literal);
+                used[eq] = true;
+                selectivity *= conjuncts[eq].selectivity;
+                any = true;
+                continue;
+            }
+            // The bounds of a window are far from independent, so the sample
+            // estimates the window as a whole rather than each bound alone
+            Condition window;
+            for (size_t r = 0; r < conjuncts.size(); ++r) {
+                if (!comparable(r, keyColumn)) continue;
+                CompareOp op = conjuncts[r].predicate.op;
+                if (op == CompareOp::EQ || op == CompareOp::NE) continue;
+                probe.addRange(op, conjuncts[r].predicate.literal);
+                used[r] = true;
+                window.children.push_back(conjuncts[r]);
+            }
+            if (!window.children.empty()) {
+                window.optimize(columnData, sample);
+                selectivity *= window.selectivity;
+                any = true;
+            }
+            break;
+        }
+        if (!any || !index->supports(probe)) continue;
+        // Prefer a hash index when it answers the same conjuncts, since a probe is O(1)
+        bool sameRows = bestIndex && used == bestUsed;
+        bool fewerRows = bestIndex ? selectivity < bestSelectivity : selectivity <= bestSelectivity;
+        if ((!sameRows && fewerRows) || (sameRows && index->kind() == "HASH")) {
+            bestIndex = index.get();
+            bestName = indexName;
+            bestProbe = probe;
+            bestUsed = used;
+            bestSelectivity = selectivity;
+        }
+    }
+
+    // Conjuncts the access path leaves to be checked row by row, in evaluation order
+    std::vector<Condition> filters;
+    for (size_t c = 0; c < conjuncts.size(); ++c) {
+        if (bestIndex && bestUsed[c]) continue;
+        filters.push_back(std::move(conjuncts[c]));
+    }
+
+    // Under EXPLAIN the pipeline is planned in full but reads nothing
+    auto planned = [&](std::unique_ptr<BatchSource> source) -> std::unique_ptr<BatchSource> {
+        if (explain == ExplainMode::PLAN) return std::make_unique<RowListScan>(std::vector<RowId>());
+        return source;
+    };
+    std::unique_ptr<BatchSource> source;
+    if (bestIndex) {
+        std::vector<RowId> indexRows;
+        if (explain != ExplainMode::PLAN) bestIndex->lookup(bestProbe, indexRows);
+        // Ranges come back in key order; hand rows out in table order like a scan would
+        std::sort(indexRows.begin(), indexRows.end());
+        lastScan.rowsExamined = indexRows.size();
+        source = std::make_unique<RowListScan>(std::move(indexRows));
+        bool fullKey = !bestProbe.hasRange() && bestProbe.equal.size() == bestIndex->keyColumns().size();
+        std::string path = fullKey ? "index lookup" : "index range scan";
+        if (bestIndex->kind() == "HASH") path = "hash index lookup";
+        std::string keyList;
+        for (int column : bestIndex->keyColumns()) {
+            keyList += (keyList.empty() ? "" : ", ") + columns[column].name;
+        }
+        lastScan.accessPath = path + " on '" + bestName + "' (" + keyList + ")";
+        std::string stageName = lastScan.accessPath;
+        stageName[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(stageName[0])));
+        for (size_t c = 0, answered = 0; c < conjuncts.size(); ++c) {
+            if (bestUsed[c]) stageName += (answered++ == 0 ? " for " : " AND ") + conjuncts[c].toString();
+        }
+        source = addStage(std::move(source), stageName, sizeof(RowId));
+    } else {
+        lastScan.accessPath = "full scan";
+        lastScan.rowsExamined = stopsEarly ? 0 : numRows;
+        size_t threads = filters.empty() && !foldsRows ? 1 : scanThreadsFor(numRows);
+        if (threads > 1) {
+            lastScan.accessPath += " on " + std::to_string(threads) + " threads";
+            // The morsels filter on their own, so the filters are part of this operator
+            OperatorProfile profile;
+            profile.name = "Parallel scan of " + std::to_string((numRows + MORSEL_ROWS - 1) / MORSEL_ROWS) +
+                           " morsel(s) on " + std::to_string(threads) + " threads";
+            for (size_t f = 0; f < filters.size(); ++f) {
+                profile.name += (f == 0 ? ", filtering " : " AND ") + filters[f].toString();
+                profile.bytesPerRow += conditionBytes(filters[f], columnData);
+            }
+            lastScan.operators.push_back(std::move(profile));
+            auto scan = std::make_unique<ParallelScan>(columnData, deleted, deletedCount, numRows, std::move(filters), threads);
+            if (stopsEarly) {
+                scan->scanIncrementally();
+                scan->countRowsRead(lastScan.rowsExamined);
+            }
+            if (explain == ExplainMode::ANALYZE) scan->profileInto(lastScan.operators.back());
+            return planned(std::move(scan));
+        }
+        auto scan = std::make_unique<TableScan>(deleted, deletedCount, 0, numRows);
+        if (stopsEarly) scan->countRowsRead(lastScan.rowsExamined);
+        // Dense batches name their rows by range, so only tombstones are read
+        source = addStage(std::move(scan), "Full scan", 0);
+    }
+
+    // Each remaining conjunct narrows the selection vector of every batch in turn
+    for (auto& filter : filters) {
+        std::string stageName = "Filter: " + filter.toString();
+        size_t bytesPerRow = conditionBytes(filter, columnData);
+        source = addStage(std::make_unique<Filter>(std::move(source), columnData, std::move(filter)), stageName, bytesPerRow);
+    }
+    return planned(std::move(source));
+}
+
+std::unique_ptr<BatchSource> Table::planIndexOrder(Condition& where, const std::vector<SortKey>& order, size_t needed) {
+    // Of the fitting indexes, the one with the fewest key columns has the smallest keys to walk
+    const Index* orderIndex = nullptr;
+    std::string orderName;
+    for (const auto& [indexName, index] : indexes) {
+        const std::vector<int>& keyColumns = index->keyColumns();
+        if (!index->keepsOrder() || keyColumns.size() < order.size()) continue;
+        bool fits = true;
+        for (size_t k = 0; k < order.size(); ++k) {
+            fits = fits && keyColumns[k] == order[k].column && order[k].descending == order[0].descending;
+        }
+        if (fits && (!orderIndex || keyColumns.size() < orderIndex->keyColumns().size())) {
+            orderIndex = index.get();
+            orderName = indexName;
+        }
+    }
+    if (!orderIndex) return nullptr;
+
+    // Walking the index reads rows until needed of them qualify. Filtering
+    // first reads at least the qualifying rows, through some index, or every
+    // row when the condition is too loose for one, and then sorts them.
+    where.optimize(columnData, sampleRows());
+    double numRows = static_cast<double>(liveRowCount());
+    double walked = needed == NO_LIMIT || where.selectivity <= 0 ? numRows : std::min(numRows, needed / where.selectivity);
+    double filtered = where.selectivity <= INDEX_MAX_SELECTIVITY ? numRows * where.selectivity : numRows;
+    if (walked > filtered) return nullptr;
+
+    lastScan = ScanInfo();
+    lastScan.rowsExpected = static_cast<size_t>(std::min(numRows * where.selectivity, static_cast<double>(needed)));
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RowId> rows;
+    std::vector<RowId> pending;
+    pending.reserve(BATCH_SIZE);
+    // Rows are filtered a batch at a time; a batch never holds more rows than
+    // are still needed, so a small LIMIT reads only as far as it must
+    auto filterPending = [&]() {
+        size_t kept = where.selectRows(columnData, pending.data(), pending.size(), pending.data());
+        rows.insert(rows.end(), pending.begin(), pending.begin() + std::min(kept, needed - rows.size()));
+        lastScan.rowsExamined += pending.size();
+        pending.clear();
+    };
+    // Under EXPLAIN the walk is planned but not done
+    if (explain != ExplainMode::PLAN) {
+        orderIndex->visitKeyOrder(order[0].descending, [&](RowId row) {
+            pending.push_back(row);
+            if (pending.size() == std::min(BATCH_SIZE, needed - rows.size())) filterPending();
+            return rows.size() < needed;
+        });
+        if (!pending.empty()) filterPending();
+    }
+
+    std::string keyList;
+    for (const SortKey& key : order) {
+        keyList += (keyList.empty() ? "" : ", ") + columns[key.column].name;
+    }
+    lastScan.accessPath = std::string(order[0].descending ? "backward " : "") + "index order scan on '" + orderName + "' (" + keyList + ")";
+    lastScan.ordering = "read in index order, no sort";
+    // The walk is done by now, so the operator is recorded with what it did
+    OperatorProfile profile;
+    profile.name = std::string(order[0].descending ? "Backward index" : "Index") + " order scan on '" + orderName + "' (" + keyList + ")";
+    if (!where.children.empty() || where.kind == Condition::COMPARE) profile.name += ", filtering " + where.toString();
+    profile.bytesPerRow = sizeof(RowId) + conditionBytes(where, columnData);
+    profile.rowsIn = lastScan.rowsExamined;
+    profile.rowsOut = rows.size();
+    profile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lastScan.operators.push_back(std::move(profile));
+    return std::make_unique<RowListScan>(std::move(rows));
+}
+
+std::vector<size_t> Table::findMatchingRows(Condition where) {
+    std::unique_ptr<BatchSource> source = planScan(std::move(where));
+    std::vector<size_t> matches;
+    Batch batch;
+    while (source->next(batch)) {
+        for (size_t i = 0; i < batch.count; ++i) {
+            matches.push_back(batch.row(i));
+        }
+    }
+    lastScan.rowsMatched = matches.size();
+    return matches;
+}
+
+std::string Table::describeLastScan() const {
+    if (explain == ExplainMode::PLAN) {
+        return lastScan.accessPath + ", about " + std::to_string(lastScan.rowsExpected) + " row(s) expected";
+    }
+    return lastScan.accessPath + ", " + std::to_string(lastScan.rowsExamined) + " row(s) examined";
+}
+
+std::vector<RowId> Table::selectRowIds(const std::string& whereClause) {
+    std::unique_ptr<BatchSource> source = planScan(compileWhere(whereClause));
+    std::vector<RowId> rows;
+    Batch batch;
+    while (source->next(batch)) {
+        for (size_t i = 0; i < batch.count; ++i) rows.push_back(batch.row(i));
+    }
+    lastScan.rowsMatched = rows.size();
+    return rows;
+}
+
+bool Table::selectRowIdsInKeyOrder(const std::string& whereClause, int column, std::vector<RowId>& rows) {
+    Condition where = compileWhere(whereClause);
+    std::unique_ptr<BatchSource> source = planIndexOrder(where, {SortKey{column, false}}, NO_LIMIT);
+    if (!source) return false;
+    rows.clear();
+    Batch batch;
+    while (source->next(batch)) {
+        for (size_t i = 0; i < batch.count; ++i) rows.push_back(batch.row(i));
+    }
+    lastScan.rowsMatched = rows.size();
+    return true;
+}
+
+const Index* Table::findKeyIndex(int column, bool ordered, std::string& indexName) const {
+    IndexProbe probe;
+    probe.equal.emplace_back();
+    const Index* best = nullptr;
+    for (const auto& [name, index] : indexes) {
+        const std::vector<int>& keyColumns = index->keyColumns();
+        if (keyColumns[0] != column || !index->supports(probe) || (ordered && !index->keepsOrder())) continue;
+        bool better = !best || (index->kind() == "HASH" && best->kind() != "HASH") ||
+                      (index->kind() == best->kind() && keyColumns.size() < best->keyColumns().size());
+        if (better) {
+            best = index.get();
+            indexName = name;
+        }
+    }
+    return best;
 }
 
 std::vector<std::vector<Value>> Table::selectRows(const std::vector<std::string>& selectedColumns, const std::string& whereClause) {
     std::vector<std::vector<Value>> resultRows;
+    Projection projection = selectBatches(selectedColumns, whereClause);
+    ColumnBatch batch;
+    while (projection.next(batch)) {
+        for (size_t i = 0; i < batch.count; ++i) {
+            std::vector<Value> selectedValues;
+            selectedValues.reserve(batch.columns.size());
+            for (const auto& column : batch.columns) {
+                selectedValues.push_back(column.get(i));
+            }
+            resultRows.push_back(std::move(selectedValues));
+        }
+    }
+    lastScan.rowsMatched = resultRows.size();
+    return resultRows;
+}
+
+Projection Table::selectBatches(const std::vector<std::string>& selectedColumns, const std::string& whereClause,
+                                const std::vector<SortKey>& order, size_t limit, size_t offset) {
     std::vector<int> selectedColIndices;
     for (const auto& colName : selectedColumns) {
         int index = getColumnIndex(colName);
@@ -79,63 +588,218 @@ std::vector<std::vector<Value>> Table::selectRows(const std::vector<std::string>
         }
         selectedColIndices.push_back(index);
     }
+    // Rows the ordered stream has to produce before LIMIT drops the rest
+    size_t needed = limit > NO_LIMIT - offset ? NO_LIMIT : limit + offset;
+    Condition where = compileWhere(whereClause);
+    std::unique_ptr<BatchSource> source;
+    if (order.empty()) {
+        source = planScan(std::move(where), false, needed != NO_LIMIT);
+    } else if (!(source = planIndexOrder(where, order, needed))) {
+        std::unique_ptr<BatchSource> scan = planScan(std::move(where));
+        auto sort = std::make_unique<Sort>(std::move(scan), columnData, order, needed, lastScan.rowsExpected);
+        std::string keyList;
+        size_t keyBytes = 0;
+        for (const SortKey& key : order) {
+            keyList += (keyList.empty() ? "" : ", ") + columns[key.column].name + (key.descending ? " DESC" : "");
+            keyBytes += valueBytes(columns[key.column].dataType);
+        }
+        // Replaced by how the rows were actually sorted once the sort runs
+        lastScan.ordering = (sort->usesHeap() ? "top-" + std::to_string(needed) + " heap by " : "full sort by ") + keyList;
+        sort->describeIn(lastScan.ordering, keyList);
+        source = addStage(std::move(sort), "Sort by " + keyList, sizeof(RowId) + keyBytes);
+    }
+    if (limit != NO_LIMIT || offset > 0) {
+        std::string stageName = "Limit " + (limit == NO_LIMIT ? std::string("none") : std::to_string(limit));
+        if (offset > 0) stageName += " offset " + std::to_string(offset);
+        source = addStage(std::make_unique<Limit>(std::move(source), limit, offset), stageName, 0);
+    }
+    // Timed by the caller under EXPLAIN ANALYZE, since it hands out column batches
+    OperatorProfile projected;
+    projected.name = "Projection:";
+    for (int column : selectedColIndices) {
+        projected.name += (projected.bytesPerRow == 0 ? " " : ", ") + columns[column].name;
+        projected.bytesPerRow += valueBytes(columns[column].dataType);
+    }
+    lastScan.operators.push_back(std::move(projected));
+    return Projection(std::move(source), columnData, std::move(selectedColIndices));
+}
 
-    std::string whereColName, whereOp, whereValueStr;
-    Value whereValue;
-    bool hasWhereClause = !whereClause.empty();
-
-    if (hasWhereClause) {
-        std::istringstream whereStream(whereClause);
-        whereStream >> whereColName >> whereOp >> whereValueStr;
-        int whereColIndex = getColumnIndex(whereColName);
-        if (whereColIndex == -1) {
-            throw std::runtime_error("Column '" + whereColName + "' in WHERE clause not found in table '" + name + "'.");
+AggregateSpec Table::compileAggregate(AggregateFunction function, const std::string& argument, const std::string& label) const {
+    AggregateSpec spec;
+    spec.function = function;
+    spec.label = label;
+    if (argument == "*") {
+        if (function != AggregateFunction::COUNT) {
+            throw std::runtime_error("Only COUNT accepts '*' in " + label + ".");
         }
-        DataType whereColType = columns[whereColIndex].dataType;
-        try {
-            if (whereColType == INT) {
-                whereValue = std::stoi(whereValueStr);
-            } else if (whereColType == REAL) {
-                whereValue = std::stod(whereValueStr);
-            } else { // TEXT
-                whereValue = whereValueStr;
+        return spec;
+    }
+    spec.column = getColumnIndex(argument);
+    if (spec.column == -1) {
+        throw std::runtime_error("Column '" + argument + "' in " + label + " not found in table '" + name + "'.");
+    }
+    spec.type = columns[spec.column].dataType;
+    if (spec.type == TEXT && (function == AggregateFunction::SUM || function == AggregateFunction::AVG)) {
+        throw std::runtime_error("Cannot compute " + label + " over TEXT column '" + columns[spec.column].name + "'.");
+    }
+    return spec;
+}
+
+// Operator that folds rows into the aggregates, for EXPLAIN
+static OperatorProfile aggregateOperator(const std::string& prefix, const std::vector<AggregateSpec>& specs) {
+    OperatorProfile profile;
+    profile.name = prefix;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        profile.name += (i == 0 ? " " : ", ") + specs[i].label;
+        if (specs[i].column != -1) profile.bytesPerRow += valueBytes(specs[i].type);
+    }
+    return profile;
+}
+
+std::vector<Accumulator> Table::aggregate(const std::vector<AggregateSpec>& specs, const std::string& whereClause) {
+    std::vector<Accumulator> states(specs.size());
+    Condition where = compileWhere(whereClause);
+    auto start = std::chrono::steady_clock::now();
+
+    // Over the whole table, COUNT is the live row count and MIN or MAX the row at
+    // one end of an ordered index led by the column, so no row is scanned
+    if (where.kind == Condition::AND && where.children.empty()) {
+        bool answered = true;
+        std::string indexNames;
+        size_t endpointRows = 0;
+        for (size_t i = 0; i < specs.size() && answered; ++i) {
+            const AggregateSpec& spec = specs[i];
+            if (spec.function == AggregateFunction::COUNT) {
+                states[i].count = liveRowCount();
+                continue;
             }
-        } catch (const std::exception& e) {
-            throw std::runtime_error("Invalid value '" + whereValueStr + "' in WHERE clause: " + e.what());
-        }
-        if (whereOp == "==") whereOp = "=";
-    }
-
-    for (int i = 0; i < rows.size(); ++i) {
-        bool conditionMet = !hasWhereClause;
-        if (hasWhereClause) {
-            int whereColIndex = getColumnIndex(whereColName);
-            Value rowValue = rows[i][whereColIndex];
-            if (whereOp == "=") {
-                conditionMet = (rowValue == whereValue);
-            } else if (whereOp == "!=") {
-                conditionMet = (rowValue != whereValue);
-            } else if (whereOp == "<" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                conditionMet = (std::get<int>(rowValue) < std::get<int>(whereValue));
-            } else if (whereOp == ">" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                conditionMet = (std::get<int>(rowValue) > std::get<int>(whereValue));
-            } else {
-                throw std::runtime_error("Unsupported operator '" + whereOp + "' or incompatible types in WHERE clause.");
+            const std::string* usedIndex = nullptr;
+            if (spec.function == AggregateFunction::MIN || spec.function == AggregateFunction::MAX) {
+                for (const auto& [indexName, index] : indexes) {
+                    if (!index->keepsOrder() || index->keyColumns()[0] != spec.column) continue;
+                    // An empty index leaves the state empty, and the result NULL
+                    RowId row;
+                    if (spec.function == AggregateFunction::MIN ? index->firstRow(row) : index->lastRow(row)) {
+                        states[i].addRow(spec, columnData, row);
+                        ++endpointRows;
+                    }
+                    usedIndex = &indexName;
+                    break;
+                }
+            }
+            if (!usedIndex) {
+                answered = false;
+            } else if (indexNames.find("'" + *usedIndex + "'") == std::string::npos) {
+                indexNames += (indexNames.empty() ? "'" : ", '") + *usedIndex + "'";
             }
         }
+        if (answered) {
+            lastScan = ScanInfo();
+            lastScan.accessPath = indexNames.empty() ? "row count from table metadata" : "ends of index " + indexNames;
+            lastScan.rowsExamined = endpointRows;
+            lastScan.rowsExpected = endpointRows;
+            lastScan.rowsMatched = liveRowCount();
+            OperatorProfile profile = aggregateOperator("Aggregate", specs);
+            profile.name += ", reading " + lastScan.accessPath;
+            profile.rowsIn = endpointRows;
+            profile.rowsOut = 1;
+            profile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            lastScan.operators.push_back(std::move(profile));
+            return states;
+        }
+        states.assign(specs.size(), Accumulator());
+    }
 
-        if (conditionMet) {
-            std::vector<Value> selectedValues;
-            for (int colIndex : selectedColIndices) {
-                selectedValues.push_back(rows[i][colIndex]);
-            }
-            resultRows.push_back(selectedValues);
+    // Otherwise every qualifying row is folded in a batch at a time; parallel
+    // scans give each morsel its own states and merge them in morsel order
+    std::unique_ptr<BatchSource> source = planScan(std::move(where), true);
+    size_t matched = 0;
+    if (auto* parallel = dynamic_cast<ParallelScan*>(source.get())) {
+        std::vector<std::vector<Accumulator>> partial(parallel->morselCount(), states);
+        std::vector<size_t> partialMatched(parallel->morselCount(), 0);
+        parallel->forEachBatch([&](size_t morsel, const Batch& batch) {
+            for (size_t i = 0; i < specs.size(); ++i) partial[morsel][i].add(specs[i], columnData, batch);
+            partialMatched[morsel] += batch.count;
+        });
+        for (size_t m = 0; m < partial.size(); ++m) {
+            for (size_t i = 0; i < specs.size(); ++i) states[i].merge(specs[i], partial[m][i]);
+            matched += partialMatched[m];
+        }
+    } else {
+        Batch batch;
+        while (source->next(batch)) {
+            for (size_t i = 0; i < specs.size(); ++i) states[i].add(specs[i], columnData, batch);
+            matched += batch.count;
         }
     }
-    return resultRows;
+    lastScan.rowsMatched = matched;
+    OperatorProfile profile = aggregateOperator("Aggregate", specs);
+    profile.rowsIn = matched;
+    profile.rowsOut = 1;
+    profile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lastScan.operators.push_back(std::move(profile));
+    return states;
+}
+
+size_t Table::estimateDistinct(const std::vector<int>& keyColumns) const {
+    std::vector<RowId> sample = sampleRows();
+    if (sample.empty()) return 0;
+    std::map<std::string, size_t> frequency;
+    for (RowId row : sample) {
+        std::string key;
+        for (int column : keyColumns) appendEncodedKey(key, columnData[column], row);
+        ++frequency[key];
+    }
+    size_t once = 0, twice = 0;
+    for (const auto& [key, count] : frequency) {
+        once += count == 1;
+        twice += count == 2;
+    }
+    size_t live = liveRowCount();
+    // A sample without repeats suggests a key that is unique or close to it;
+    // otherwise the Chao1 estimator extrapolates from the rare keys
+    if (once == sample.size()) return live;
+    double estimate = frequency.size() + static_cast<double>(once) * once / (2.0 * std::max<size_t>(twice, 1));
+    return std::min(live, static_cast<size_t>(estimate));
+}
+
+GroupedResult Table::aggregateGroups(const std::vector<int>& keyColumns, const std::vector<AggregateSpec>& specs,
+                                     const std::string& whereClause) {
+    size_t estimate = estimateDistinct(keyColumns);
+    GroupStrategy strategy = estimate > HASH_AGGREGATION_MAX_GROUPS ? GroupStrategy::SORT : GroupStrategy::HASH;
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<BatchSource> source = planScan(compileWhere(whereClause), true);
+    GroupedResult groups = groupRows(columnData, keyColumns, specs, *source, strategy);
+    std::string keyList;
+    size_t keyBytes = 0;
+    for (int column : keyColumns) {
+        keyList += (keyList.empty() ? "" : ", ") + columns[column].name;
+        keyBytes += valueBytes(columns[column].dataType);
+    }
+    OperatorProfile profile = aggregateOperator("Group by " + keyList + " computing", specs);
+    profile.bytesPerRow += keyBytes;
+    profile.rowsOut = groups.keyRows.size();
+    profile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t matched = 0;
+    for (size_t g = 0; g < groups.keyRows.size(); ++g) {
+        // Every spec sees every row of its group, COUNT(*) included
+        matched += specs.empty() ? 0 : groups.states[g * specs.size()].count;
+    }
+    lastScan.rowsMatched = matched;
+    profile.rowsIn = matched;
+    lastScan.operators.push_back(std::move(profile));
+    std::string method = strategy == GroupStrategy::HASH ? "hash aggregation" : "sort aggregation";
+    if (explain == ExplainMode::PLAN) {
+        lastScan.aggregation = method + ", about " + std::to_string(estimate) + " group(s) estimated";
+    } else {
+        lastScan.aggregation = method + " into " + std::to_string(groups.keyRows.size()) + " group(s), about " +
+                               std::to_string(estimate) + " estimated";
+    }
+    return groups;
 }
 
 void Table::updateRows(const std::string& setClause, const std::string& whereClause) {
+    std::vector<std::pair<int, Value>> assignments;
     std::istringstream setStream(setClause);
     std::string updatePair;
     while (std::getline(setStream, updatePair, ',')) {
@@ -150,131 +814,99 @@ void Table::updateRows(const std::string& setClause, const std::string& whereCla
         if (setColIndex == -1) {
             throw std::runtime_error("Column '" + setColName + "' in SET clause not found in table '" + name + "'.");
         }
-        DataType setColType = columns[setColIndex].dataType;
         Value setValue;
         try {
-            if (setColType == INT) {
-                setValue = std::stoi(setValueStr);
-            } else if (setColType == REAL) {
-                setValue = std::stod(setValueStr);
-            } else { // TEXT
-                setValue = setValueStr;
-            }
+            setValue = parseLiteral(columns[setColIndex].dataType, setValueStr);
         } catch (const std::exception& e) {
             throw std::runtime_error("Invalid value '" + setValueStr + "' in SET clause: " + e.what());
         }
+        assignments.emplace_back(setColIndex, setValue);
+    }
 
-        std::string whereColName, whereOp, whereValueStr;
-        Value whereValue;
-        bool hasWhereClause = !whereClause.empty();
-        if (hasWhereClause) {
-            std::istringstream whereStream(whereClause);
-            whereStream >> whereColName >> whereOp >> whereValueStr;
-            int whereColIndex = getColumnIndex(whereColName);
-            if (whereColIndex == -1) {
-                throw std::runtime_error("Column '" + whereColName + "' in WHERE clause not found in table '" + name + "'.");
-            }
-            DataType whereColType = columns[whereColIndex].dataType;
-            try {
-                if (whereColType == INT) {
-                    whereValue = std::stoi(whereValueStr);
-                } else if (whereColType == REAL) {
-                    whereValue = std::stod(whereValueStr);
-                } else { // TEXT
-                    whereValue = whereValueStr;
-                }
-            } catch (const std::exception& e) {
-                throw std::runtime_error("Invalid value '" + whereValueStr + "' in WHERE clause: " + e.what());
-            }
-            if (whereOp == "==") whereOp = "=";
-        }
-
-        for (int i = 0; i < rows.size(); ++i) {
-            bool conditionMet = !hasWhereClause;
-            if (hasWhereClause) {
-                int whereColIndex = getColumnIndex(whereColName);
-                Value rowValue = rows[i][whereColIndex];
-                if (whereOp == "=") {
-                    conditionMet = (rowValue == whereValue);
-                } else if (whereOp == "!=") {
-                    conditionMet = (rowValue != whereValue);
-                } else if (whereOp == "<" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                    conditionMet = (std::get<int>(rowValue) < std::get<int>(whereValue));
-                } else if (whereOp == ">" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                    conditionMet = (std::get<int>(rowValue) > std::get<int>(whereValue));
-                } else {
-                    throw std::runtime_error("Unsupported operator '" + whereOp + "' or incompatible types in WHERE clause.");
-                }
-            }
-
-            if (conditionMet) {
-                rows[i][setColIndex] = setValue;
-                if (indexes.count(setColName)) {
-                    indexes[setColName].clear();
-                    for (int j = 0; j < rows.size(); ++j) {
-                        indexes[setColName][rows[j][setColIndex]].push_back(j);
-                    }
-                }
+    // Match before assigning so a SET on the WHERE column can't change which rows qualify
+    std::vector<size_t> matches = findMatchingRows(compileWhere(whereClause));
+
+    // Only indexes with an assigned column in their key need their entries moved
+    std::vector<Index*> affected;
+    for (auto& [indexName, index] : indexes) {
+        for (const auto& assignment : assignments) {
+            const auto& keyColumns = index->keyColumns();
+            if (std::find(keyColumns.begin(), keyColumns.end(), assignment.first) != keyColumns.end()) {
+                affected.push_back(index.get());
+                break;
             }
         }
     }
+    // Take the rows out of the affected indexes under their old keys, assign,
+    // then put them back under the new keys. Each index is maintained by one
+    // thread and the assignments are split into morsels, so a large update
+    // spreads over the scan threads.
+    ThreadPool& pool = ThreadPool::shared();
+    size_t threads = scanThreadsFor(matches.size());
+    pool.parallelFor(affected.size(), [&](size_t i) {
+        for (size_t row : matches) {
+            affected[i]->erase(columnData, static_cast<RowId>(row));
+        }
+    }, threads);
+    pool.parallelFor((matches.size() + MORSEL_ROWS - 1) / MORSEL_ROWS, [&](size_t morsel) {
+        size_t end = std::min(matches.size(), (morsel + 1) * MORSEL_ROWS);
+        for (size_t i = morsel * MORSEL_ROWS; i < end; ++i) {
+            for (const auto& [setColIndex, setValue] : assignments) {
+                columnData[setColIndex].set(matches[i], setValue);
+            }
+        }
+    }, threads);
+    pool.parallelFor(affected.size(), [&](size_t i) {
+        for (size_t row : matches) {
+            affected[i]->insert(columnData, static_cast<RowId>(row));
+        }
+    }, threads);
 }
 
 void Table::deleteRows(const std::string& whereClause) {
-    std::string whereColName, whereOp, whereValueStr;
-    Value whereValue;
-    bool hasWhereClause = !whereClause.empty();
-
-    if (hasWhereClause) {
-        std::istringstream whereStream(whereClause);
-        whereStream >> whereColName >> whereOp >> whereValueStr;
-        int whereColIndex = getColumnIndex(whereColName);
-        if (whereColIndex == -1) {
-            throw std::runtime_error("Column '" + whereColName + "' in WHERE clause not found in table '" + name + "'.");
-        }
-        DataType whereColType = columns[whereColIndex].dataType;
-        try {
-            if (whereColType == INT) {
-                whereValue = std::stoi(whereValueStr);
-            } else if (whereColType == REAL) {
-                whereValue = std::stod(whereValueStr);
-            } else { // TEXT
-                whereValue = whereValueStr;
-            }
-        } catch (const std::exception& e) {
-            throw std::runtime_error("Invalid value '" + whereValueStr + "' in WHERE clause: " + e.what());
-        }
-        if (whereOp == "==") whereOp = "=";
-    }
-
-    std::vector<std::vector<Value>> newRows;
-    for (int i = 0; i < rows.size(); ++i) {
-        bool conditionMet = !hasWhereClause;
-        if (hasWhereClause) {
-            int whereColIndex = getColumnIndex(whereColName);
-            Value rowValue = rows[i][whereColIndex];
-            if (whereOp == "=") {
-                conditionMet = (rowValue == whereValue);
-            } else if (whereOp == "!=") {
-                conditionMet = (rowValue != whereValue);
-            } else if (whereOp == "<" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                conditionMet = (std::get<int>(rowValue) < std::get<int>(whereValue));
-            } else if (whereOp == ">" && std::holds_alternative<int>(rowValue) && std::holds_alternative<int>(whereValue)) {
-                conditionMet = (std::get<int>(rowValue) > std::get<int>(whereValue));
-            } else {
-                throw std::runtime_error("Unsupported operator '" + whereOp + "' or incompatible types in WHERE clause.");
-            }
+    std::vector<size_t> matches = findMatchingRows(compileWhere(whereClause));
+    // Indexes are independent, so each one drops the rows on its own thread
+    std::vector<Index*> tableIndexes;
+    for (auto& [indexName, index] : indexes) {
+        tableIndexes.push_back(index.get());
+    }
+    ThreadPool::shared().parallelFor(tableIndexes.size(), [&](size_t i) {
+        for (size_t row : matches) {
+            tableIndexes[i]->erase(columnData, static_cast<RowId>(row));
         }
+    }, scanThreadsFor(matches.size()));
+    for (size_t row : matches) {
+        deleted[row] = true;
+    }
+    deletedCount += matches.size();
 
-        if (!conditionMet) {
-            newRows.push_back(rows[i]);
-        }
+    // Reclaim space once tombstones make up half of the table
+    if (deletedCount > 0 && deletedCount * 2 >= rowCount()) {
+        vacuum();
     }
-    rows = newRows;
+}
 
-    for (auto const& [colName, indexMap] : indexes) {
-        createIndex(colName); // Rebuild indexes
+void Table::vacuum() {
+    if (deletedCount == 0) {
+        return;
+    }
+    size_t numRows = rowCount();
+    std::vector<bool> keep(numRows);
+    std::vector<RowId> newRowIds(numRows, INVALID_ROW);
+    RowId nextRow = 0;
+    for (size_t i = 0; i < numRows; ++i) {
+        keep[i] = !deleted[i];
+        if (keep[i]) newRowIds[i] = nextRow++;
+    }
+    for (auto& column : columnData) {
+        column.compact(keep);
+    }
+    // Surviving rows shift down; renumber index entries instead of rebuilding them
+    for (auto& [indexName, index] : indexes) {
+        index->remap(newRowIds);
     }
+    deleted.assign(nextRow, false);
+    deletedCount = 0;
 }
 
 void Table::printTable() const {
@@ -284,10 +916,12 @@ void Table::printTable() const {
         columnWidths.push_back(headerText.length());
     }
 
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size(); ++i) {
+    size_t numRows = rowCount();
+    for (size_t i = 0; i < columnData.size(); ++i) {
+        for (size_t r = 0; r < numRows; ++r) {
+            if (deleted[r]) continue;
             std::stringstream ss;
-            ss << row[i];
+            ss << columnData[i].get(r);
             columnWidths[i] = std::max(columnWidths[i], ss.str().length());
         }
     }
@@ -322,12 +956,13 @@ void Table::printTable() const {
     std::cout << Colors::RESET << "\n";
 
     // Print rows
-    for (const auto& row : rows) {
+    for (size_t r = 0; r < numRows; ++r) {
+        if (deleted[r]) continue;
         std::cout << Colors::CYAN << "│ ";
-        for (size_t i = 0; i < row.size(); ++i) {
+        for (size_t i = 0; i < columnData.size(); ++i) {
             std::stringstream ss;
-            ss << row[i];
-            std::cout << std::setw(columnWidths[i]) << std::left << ss.str() << (i < row.size() - 1 ? " │ " : " │");
+            ss << columnData[i].get(r);
+            std::cout << std::setw(columnWidths[i]) << std::left << ss.str() << (i < columnData.size() - 1 ? " │ " : " │");
         }
         std::cout << Colors::RESET << "\n";
     }
@@ -340,7 +975,7 @@ void Table::printTable() const {
         std::cout << line << (i < columns.size() - 1 ? "┴" : "┘");
     }
     std::cout << Colors::RESET << "\n";
-    std::cout << Colors::GREEN << "► " << rows.size() << " row(s) in set" << Colors::RESET << "\n\n";
+    std::cout << Colors::GREEN << "► " << liveRowCount() << " row(s) in set" << Colors::RESET << "\n\n";
 }
 
 std::string Table::dataTypeToString(DataType dt) const {
@@ -426,6 +1061,17 @@ void Database::executeQuery(const std::string& sqlQuery) {
         parseUpdate(queryStream);
     } else if (toLower(command) == "delete") {
         parseDelete(queryStream);
+    } else if (toLower(command) == "vacuum") {
+        std::string tableName;
+        queryStream >> tableName;
+        Table& table = getTable(tableName);
+        size_t reclaimed = table.deletedCount;
+        table.vacuum();
+        std::cout << "Table '" << tableName << "' vacuumed, " << reclaimed << " deleted row(s) reclaimed." << std::endl;
+    } else if (toLower(command) == "set") {
+        parseSet(queryStream);
+    } else if (toLower(command) == "explain") {
+        parseExplain(queryStream);
     } else if (toLower(command) == "print") {
         std::string type;
         queryStream >> type;
@@ -439,49 +1085,40 @@ void Database::executeQuery(const std::string& sqlQuery) {
     } else {
         throw std::runtime_error("Unknown command: " + command);
     }
-}
 
-void Database::saveDatabase(const std::string& filename) const {
-    std::ofstream outFile(filename);
-    if (!outFile.is_open()) {
-        throw std::runtime_error("Failed to open file '" + filename + "' for saving database.");
+    // Only statements that completed are logged, so replay never re-raises their errors
+    std::string lowerCommand = toLower(command);
+    bool changesData = lowerCommand == "create" || lowerCommand == "insert" ||
+                       lowerCommand == "update" || lowerCommand == "delete";
+    if (wal && !replaying && changesData) {
+        wal->append(sqlQuery);
     }
+}
 
-    outFile << "DATABASE_NAME " << name << std::endl;
-    outFile << "TABLE_COUNT " << tables.size() << std::endl;
-
-    for (const auto& [tableName, table] : tables) {
-        outFile << "TABLE_NAME " << table.name << std::endl;
-        outFile << "COLUMN_COUNT " << table.columns.size() << std::endl;
-
-        for (const auto& col : table.columns) {
-            outFile << "COLUMN " << col.name << " " << static_cast<int>(col.dataType) << std::endl;
-        }
-
-        outFile << "ROW_COUNT " << table.rows.size() << std::endl;
-
-        for (const auto& row : table.rows) {
-            outFile << "ROW";
-            for (size_t i = 0; i < row.size(); ++i) {
-                const auto& value = row[i];
-                if (i > 0) outFile << " ";
-                if (std::holds_alternative<int>(value)) {
-                    outFile << "I " << std::get<int>(value);
-                } else if (std::holds_alternative<std::string>(value)) {
-                    outFile << "T \"" << std::get<std::string>(value) << "\"";
-                } else if (std::holds_alternative<double>(value)) {
-                    outFile << "R " << std::get<double>(value);
-                }
-            }
-            outFile << std::endl;
-        }
+void Database::saveDatabase(const std::string& filename) const {
+    Snapshot::save(*this, filename);
+    // Everything logged so far is now in the snapshot
+    if (wal) {
+        wal->reset(filename);
     }
-
-    outFile.close();
     std::cout << "Database '" << name << "' saved to '" << filename << "'" << std::endl;
 }
 
 void Database::loadDatabase(const std::string& filename) {
+    if (Snapshot::isSnapshot(filename)) {
+        std::map<std::string, Table> newTables;
+        std::string newName;
+        Snapshot::load(filename, newName, newTables);
+        name = newName;
+        tables = std::move(newTables);
+        if (wal) {
+            wal->reset(filename);
+        }
+        std::cout << "Database '" << name << "' loaded from '" << filename << "'" << std::endl;
+        return;
+    }
+
+    // Files written before the binary snapshot format use the line-based text layout
     std::ifstream inFile(filename);
     if (!inFile.is_open()) {
         throw std::runtime_error("Database file not found: " + filename);
@@ -595,9 +1232,71 @@ void Database::loadDatabase(const std::string& filename) {
 
     inFile.close();
     tables = std::move(newTables);
+    if (wal) {
+        wal->reset(filename);
+    }
     std::cout << "Database '" << name << "' loaded from '" << filename << "'" << std::endl;
 }
 
+void Database::recover(const std::string& defaultSnapshot, const std::string& walPath, const WriteAheadLog::Options& options) {
+    std::string baseSnapshot = defaultSnapshot;
+    bool sawBase = false;
+    size_t replayed = 0, failed = 0;
+
+    auto loadBase = [&](const std::string& snapshot) {
+        try {
+            loadDatabase(snapshot);
+        } catch (const std::runtime_error& error) {
+            std::cerr << "Warning: Could not load database from file. Starting with a new database. Error: " << error.what() << std::endl;
+        }
+    };
+
+    replaying = true;
+    uint64_t validBytes = WriteAheadLog::replay(walPath,
+        [&](const std::string& base) {
+            sawBase = true;
+            baseSnapshot = base;
+            loadBase(base);
+        },
+        [&](const std::string& statement) {
+            // Silence per-statement output; a long log would otherwise flood the terminal
+            std::streambuf* console = std::cout.rdbuf(nullptr);
+            try {
+                executeQuery(statement);
+                ++replayed;
+            } catch (const std::runtime_error& error) {
+                ++failed;
+                std::cerr << "Warning: Skipping logged statement '" << statement << "': " << error.what() << std::endl;
+            }
+            std::cout.rdbuf(console);
+            std::cout.clear();
+        });
+    replaying = false;
+    if (!sawBase) {
+        loadBase(defaultSnapshot);
+    }
+
+    // Drop a torn tail left by a crash mid-append before appending after it
+    std::ifstream logFile(walPath, std::ios::binary | std::ios::ate);
+    if (logFile.is_open() && static_cast<uint64_t>(logFile.tellg()) > validBytes) {
+        logFile.close();
+        if (::truncate(walPath.c_str(), static_cast<off_t>(validBytes)) != 0) {
+            throw std::runtime_error("Failed to truncate damaged write-ahead log '" + walPath + "'.");
+        }
+        std::cerr << "Warning: Discarded a damaged record at the end of '" << walPath << "'." << std::endl;
+    }
+
+    wal = std::make_unique<WriteAheadLog>(walPath, options);
+    if (!sawBase) {
+        wal->reset(baseSnapshot);
+    }
+    if (replayed > 0 || failed > 0) {
+        std::cout << "Replayed " << replayed << " statement(s) from write-ahead log '" << walPath << "'";
+        if (failed > 0) std::cout << " (" << failed << " skipped)";
+        std::cout << "." << std::endl;
+    }
+}
+
 std::string Database::trim(const std::string& str) const {
     const std::string whitespace = " \t\n\r\f\v";
     size_t first = str.find_first_not_of(whitespace);
@@ -613,6 +1312,11 @@ std::string Database::toLower(std::string str) const {
     return str;
 }
 
+std::string Database::toUpper(std::string str) const {
+    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+    return str;
+}
+
 void Database::parseCreateTable(std::istringstream& queryStream) {
     std::string tableName;
     queryStream >> tableName;
@@ -704,22 +1408,565 @@ void Database::parseInsert(std::istringstream& queryStream) {
     std::cout << "Row inserted into table '" << tableName << "'" << std::endl;
 }
 
-void Database::parseSelect(std::istringstream& queryStream) {
-    std::vector<std::string> selectColumns;
-    std::string columnName;
-    while (queryStream >> columnName && toLower(columnName) != "from") {
-        if (columnName == "*") {
-            selectColumns.push_back("*");
-            if (queryStream.peek() == ',') queryStream.ignore();
+// Prints rows of preformatted values in the bordered layout of SELECT results
+static void printResultTable(const std::vector<std::string>& headings, const std::vector<std::vector<std::string>>& rows) {
+    std::vector<size_t> widths;
+    for (const auto& heading : headings) widths.push_back(heading.length());
+    for (const auto& row : rows) {
+        for (size_t c = 0; c < row.size(); ++c) widths[c] = std::max(widths[c], row[c].length());
+    }
+    auto printBorder = [&]() {
+        std::cout << "+";
+        for (size_t width : widths) std::cout << std::string(width + 2, '-') << "+";
+        std::cout << std::endl;
+    };
+    auto printRow = [&](const std::vector<std::string>& values) {
+        std::cout << "|";
+        for (size_t c = 0; c < values.size(); ++c) {
+            std::cout << " " << std::setw(widths[c]) << std::left << values[c] << " |";
+        }
+        std::cout << '\n';
+    };
+    printBorder();
+    printRow(headings);
+    printBorder();
+    for (const auto& row : rows) printRow(row);
+    printBorder();
+    std::cout << "► " << rows.size() << " row(s) in set" << std::endl;
+}
+
+// Byte count in the largest binary unit that keeps it at least 1, e.g. "1.5 MB"
+static std::string formatBytes(double bytes) {
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        ++unit;
+    }
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << " " << units[unit];
+    return text.str();
+}
+
+static std::string formatMilliseconds(double seconds) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3) << seconds * 1000 << " ms";
+    return text.str();
+}
+
+// Prints a pipeline with its last operator first and every other one indented
+// under the operator that reads its rows. Under EXPLAIN ANALYZE each line also
+// shows the rows the operator read and produced, its wall time (the operators
+// below included) and the bytes of values and row ids it read.
+static void printOperators(const ScanInfo& scan, bool analyze, const std::string& indent) {
+    const std::deque<OperatorProfile>& operators = scan.operators;
+    for (size_t i = operators.size(); i-- > 0;) {
+        const OperatorProfile& op = operators[i];
+        std::cout << indent << std::string(2 * (operators.size() - 1 - i), ' ') << "-> " << op.name;
+        if (analyze) {
+            size_t rowsIn = op.rowsIn != 0 ? op.rowsIn : i == 0 ? scan.rowsExamined : operators[i - 1].rowsOut;
+            std::cout << " (rows in " << rowsIn << ", out " << op.rowsOut << ", " << formatMilliseconds(op.seconds)
+                      << ", " << formatBytes(static_cast<double>(rowsIn) * op.bytesPerRow) << ")";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// What a SELECT on one table prints under EXPLAIN in place of its rows
+static void printPlan(const Table& table) {
+    std::cout << "Plan:" << std::endl;
+    printOperators(table.lastScan, table.explain == ExplainMode::ANALYZE, "  ");
+    std::cout << "Access path: " << table.describeLastScan() << std::endl;
+    if (!table.lastScan.ordering.empty()) {
+        std::cout << "Ordering: " << table.lastScan.ordering << std::endl;
+    }
+    if (!table.lastScan.aggregation.empty()) {
+        std::cout << "Aggregation: " << table.lastScan.aggregation << std::endl;
+    }
+}
+
+// Drops the result rows before offset and those after the next limit ones
+static void applyLimit(std::vector<std::vector<std::string>>& rows, size_t limit, size_t offset) {
+    rows.erase(rows.begin(), rows.begin() + std::min(offset, rows.size()));
+    if (limit < rows.size()) rows.resize(limit);
+}
+
+// Value of a LIMIT or OFFSET clause: a non-negative integer
+static size_t parseRowCount(const std::string& text, const std::string& clause) {
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        throw std::runtime_error("Expected a non-negative integer after " + clause + ", got '" + text + "'.");
+    }
+    try {
+        return std::stoull(text);
+    } catch (const std::out_of_range&) {
+        throw std::runtime_error("Value '" + text + "' of " + clause + " is too large.");
+    }
+}
+
+// End of keyword (one or more words, such as "group by") if it starts at
+// text[i] as whole words, else npos
+static size_t matchKeyword(const std::string& text, size_t i, const std::string& keyword) {
+    if (i > 0 && !std::isspace(static_cast<unsigned char>(text[i - 1])) && text[i - 1] != ')') return std::string::npos;
+    for (size_t k = 0; k < keyword.size(); ++k) {
+        if (keyword[k] == ' ') {
+            if (i >= text.size() || !std::isspace(static_cast<unsigned char>(text[i]))) return std::string::npos;
+            while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+        } else if (i < text.size() && std::tolower(static_cast<unsigned char>(text[i])) == keyword[k]) {
+            ++i;
+        } else {
+            return std::string::npos;
+        }
+    }
+    if (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i])) && text[i] != '(') return std::string::npos;
+    return i;
+}
+
+// Splits what follows the table name of a SELECT into its clauses. keywords
+// lists the clauses allowed, in the order they must appear; each found one
+// maps to its trimmed text, and text before the first one, if any, maps to
+// "". Keywords out of order or without text are syntax errors.
+std::map<std::string, std::string> Database::splitClauses(const std::string& tail, const std::vector<std::string>& keywords) const {
+    std::string text = trim(tail);
+    if (!text.empty() && text.back() == ';') text = trim(text.substr(0, text.size() - 1));
+
+    // (start, end) of every keyword found outside quoted literals, in text order
+    std::vector<std::pair<size_t, size_t>> bounds;
+    std::vector<size_t> which;
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\'') quoted = !quoted;
+        if (quoted) continue;
+        for (size_t k = 0; k < keywords.size(); ++k) {
+            size_t end = matchKeyword(text, i, keywords[k]);
+            if (end == std::string::npos) continue;
+            if (!which.empty() && k <= which.back()) {
+                std::string order;
+                for (const auto& keyword : keywords) order += (order.empty() ? "" : ", ") + toUpper(keyword);
+                throw std::runtime_error("Unexpected " + toUpper(keywords[k]) + " in SELECT query; clauses go in the order " + order + ".");
+            }
+            bounds.emplace_back(i, end);
+            which.push_back(k);
+            i = end - 1;
             break;
+        }
+    }
+
+    std::map<std::string, std::string> clauses;
+    std::string leading = trim(text.substr(0, bounds.empty() ? text.size() : bounds[0].first));
+    if (!leading.empty()) clauses[""] = leading;
+    for (size_t c = 0; c < bounds.size(); ++c) {
+        size_t end = c + 1 < bounds.size() ? bounds[c + 1].first : text.size();
+        std::string body = trim(text.substr(bounds[c].second, end - bounds[c].second));
+        if (body.empty()) {
+            throw std::runtime_error("Expected an expression after " + toUpper(keywords[which[c]]) + ".");
+        }
+        clauses[keywords[which[c]]] = body;
+    }
+    return clauses;
+}
+
+// SELECT ... GROUP BY: plain columns in the select list must be grouping
+// columns, and are printed from a row of each group
+void Database::printGroups(Table& table, const std::vector<std::string>& selectColumns,
+                           const std::vector<AggregateSpec>& aggregates, const std::vector<int>& aggregateOf,
+                           const std::string& groupClause, const std::string& whereClause, size_t limit, size_t offset) {
+    std::vector<int> keyColumns;
+    std::istringstream groupStream(groupClause);
+    std::string columnName;
+    while (std::getline(groupStream, columnName, ',')) {
+        int column = table.getColumnIndex(trim(columnName));
+        if (column == -1) {
+            throw std::runtime_error("Column '" + trim(columnName) + "' in GROUP BY not found in table '" + table.name + "'.");
+        }
+        if (std::find(keyColumns.begin(), keyColumns.end(), column) == keyColumns.end()) keyColumns.push_back(column);
+    }
+    std::vector<int> outputColumns(selectColumns.size(), -1);
+    for (size_t i = 0; i < selectColumns.size(); ++i) {
+        if (aggregateOf[i] != -1) continue;
+        outputColumns[i] = table.getColumnIndex(selectColumns[i]);
+        if (std::find(keyColumns.begin(), keyColumns.end(), outputColumns[i]) == keyColumns.end()) {
+            throw std::runtime_error("Column '" + selectColumns[i] + "' must appear in GROUP BY or inside an aggregate function.");
+        }
+    }
+
+    GroupedResult groups = table.aggregateGroups(keyColumns, aggregates, whereClause);
+    if (table.explain != ExplainMode::OFF) {
+        printPlan(table);
+        return;
+    }
+    std::vector<std::vector<std::string>> rows;
+    rows.reserve(groups.keyRows.size());
+    for (size_t g = 0; g < groups.keyRows.size(); ++g) {
+        std::vector<std::string> values;
+        for (size_t i = 0; i < selectColumns.size(); ++i) {
+            if (aggregateOf[i] != -1) {
+                values.push_back(groups.states[g * aggregates.size() + aggregateOf[i]].result(aggregates[aggregateOf[i]]));
+            } else {
+                std::ostringstream value;
+                value << table.getValue(groups.keyRows[g], outputColumns[i]);
+                values.push_back(value.str());
+            }
+        }
+        rows.push_back(std::move(values));
+    }
+    applyLimit(rows, limit, offset);
+    printResultTable(selectColumns, rows);
+    std::cout << "Access path: " << table.describeLastScan() << std::endl;
+    std::cout << "Aggregation: " << table.lastScan.aggregation << std::endl;
+}
+
+// Name a side of a join goes by: its alias from "[AS] alias", else the table name
+static std::string joinSideName(const std::string& aliasText, const std::string& tableName) {
+    std::istringstream stream(aliasText);
+    std::vector<std::string> words;
+    std::string word;
+    while (stream >> word) words.push_back(word);
+    if (!words.empty() && (words[0] == "AS" || words[0] == "as" || words[0] == "As")) words.erase(words.begin());
+    if (words.size() > 1 || (words.empty() && !aliasText.empty())) {
+        throw std::runtime_error("Expected at most an alias after table '" + tableName + "', got '" + aliasText + "'.");
+    }
+    return words.empty() ? tableName : words[0];
+}
+
+// Copy of a condition with "qualifier." dropped in front of column names,
+// outside quoted literals
+static std::string stripQualifier(const std::string& text, const std::string& qualifier) {
+    std::string prefix = qualifier + ".";
+    std::string stripped;
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\'') quoted = !quoted;
+        bool startsName = i == 0 || !(std::isalnum(static_cast<unsigned char>(text[i - 1])) || text[i - 1] == '_' || text[i - 1] == '.');
+        if (!quoted && startsName && text.compare(i, prefix.size(), prefix) == 0) {
+            i += prefix.size() - 1;
+            continue;
+        }
+        stripped += text[i];
+    }
+    return stripped;
+}
+
+// SELECT ... FROM a [alias] JOIN b [alias] ON a.x = b.y [WHERE ...]: every
+// top-level AND term of the WHERE clause is pushed down to the one table
+// whose columns it uses, each side is scanned with its own terms, and the
+// surviving rows are joined on the ON columns
+void Database::printJoin(Table& leftTable, const std::string& leftAlias, const std::string& joinClause,
+                         const std::string& onClause, const std::vector<std::string>& selectColumns,
+                         const std::string& whereClause, size_t limit, size_t offset) {
+    std::istringstream joinStream(joinClause);
+    std::string rightName;
+    joinStream >> rightName;
+    std::string rightAlias;
+    std::getline(joinStream, rightAlias);
+    Table& rightTable = getTable(rightName);
+    Table* tables[2] = {&leftTable, &rightTable};
+    std::string names[2] = {joinSideName(trim(leftAlias), leftTable.name), joinSideName(trim(rightAlias), rightTable.name)};
+    if (names[0] == names[1]) {
+        throw std::runtime_error("Both sides of the join are called '" + names[0] + "'; give them different aliases.");
+    }
+
+    // "side.column" or a column name found in just one of the tables
+    auto resolve = [&](const std::string& reference) {
+        std::string ref = trim(reference);
+        size_t dot = ref.find('.');
+        if (dot != std::string::npos) {
+            std::string qualifier = ref.substr(0, dot);
+            int side = qualifier == names[0] ? 0 : qualifier == names[1] ? 1 : -1;
+            if (side == -1) {
+                throw std::runtime_error("Unknown table or alias '" + qualifier + "' in '" + ref + "'.");
+            }
+            int column = tables[side]->getColumnIndex(ref.substr(dot + 1));
+            if (column == -1) {
+                throw std::runtime_error("Column '" + ref.substr(dot + 1) + "' not found in '" + names[side] + "'.");
+            }
+            return std::make_pair(side, column);
+        }
+        int leftColumn = tables[0]->getColumnIndex(ref);
+        int rightColumn = tables[1]->getColumnIndex(ref);
+        if (leftColumn != -1 && rightColumn != -1) {
+            throw std::runtime_error("Column '" + ref + "' is in both joined tables; qualify it, e.g. " + names[0] + "." + ref + ".");
+        }
+        if (leftColumn == -1 && rightColumn == -1) {
+            throw std::runtime_error("Column '" + ref + "' not found in '" + names[0] + "' or '" + names[1] + "'.");
+        }
+        return leftColumn != -1 ? std::make_pair(0, leftColumn) : std::make_pair(1, rightColumn);
+    };
+
+    size_t equals = onClause.find('=');
+    if (equals == std::string::npos) {
+        throw std::runtime_error("Expected ON left.column = right.column, got '" + onClause + "'.");
+    }
+    size_t rhs = onClause.compare(equals, 2, "==") == 0 ? equals + 2 : equals + 1;
+    std::pair<int, int> keys[2] = {resolve(onClause.substr(0, equals)), resolve(onClause.substr(rhs))};
+    if (keys[0].first == keys[1].first) {
+        throw std::runtime_error("ON must compare a column of each joined table, got '" + onClause + "'.");
+    }
+    if (keys[0].first == 1) std::swap(keys[0], keys[1]);
+    DataType keyTypes[2] = {tables[0]->columns[keys[0].second].dataType, tables[1]->columns[keys[1].second].dataType};
+    if (!joinable(keyTypes[0], keyTypes[1])) {
+        std::ostringstream message;
+        message << "Cannot join " << keyTypes[0] << " column '" << names[0] << "." << tables[0]->columns[keys[0].second].name
+                << "' with " << keyTypes[1] << " column '" << names[1] << "." << tables[1]->columns[keys[1].second].name << "'.";
+        throw std::runtime_error(message.str());
+    }
+
+    // A term compiles against a side once that side's qualifier is dropped;
+    // terms naming the other side's columns, or columns it lacks, do not
+    std::string sideWhere[2];
+    if (!trim(whereClause).empty()) {
+        for (const std::string& term : splitTopLevel(whereClause, "and")) {
+            std::string stripped[2];
+            std::string errors[2];
+            bool fits[2];
+            for (int side = 0; side < 2; ++side) {
+                stripped[side] = stripQualifier(term, names[side]);
+                try {
+                    tables[side]->compileWhere(stripped[side]);
+                    fits[side] = true;
+                } catch (const std::exception& e) {
+                    errors[side] = e.what();
+                    fits[side] = false;
+                }
+            }
+            if (fits[0] && fits[1]) {
+                throw std::runtime_error("Condition '" + trim(term) + "' fits both joined tables; qualify its columns.");
+            }
+            if (!fits[0] && !fits[1]) {
+                // A term qualified for one side only failed for its own reasons
+                bool qualified[2] = {stripped[0] != term, stripped[1] != term};
+                if (qualified[0] != qualified[1]) throw std::runtime_error(errors[qualified[0] ? 0 : 1]);
+                throw std::runtime_error("Condition '" + trim(term) + "' must use the columns of one joined table only.");
+            }
+            int side = fits[0] ? 0 : 1;
+            sideWhere[side] += (sideWhere[side].empty() ? "(" : " AND (") + stripped[side] + ")";
+        }
+    }
+
+    // Rows each side is expected to keep, and to read when it is scanned:
+    // just those through an index when its conditions are selective enough
+    // for one, else all of them
+    Condition conditions[2];
+    double expected[2];
+    double scanned[2];
+    for (int side = 0; side < 2; ++side) {
+        conditions[side] = tables[side]->planWhere(sideWhere[side]);
+        double live = static_cast<double>(tables[side]->liveRowCount());
+        expected[side] = live * conditions[side].selectivity;
+        scanned[side] = conditions[side].selectivity <= INDEX_MAX_SELECTIVITY ? expected[side] : live;
+    }
+
+    // An index nested-loop join looks the inner rows up at about log2(n) per
+    // driver row instead of reading the inner side; it pays off when that
+    // costs less than scanning it
+    auto lookupCost = [&](int inner, double driverRows) {
+        return driverRows * std::log2(static_cast<double>(tables[inner]->liveRowCount()) + 2);
+    };
+    int inner = -1;
+    const Index* innerIndex = nullptr;
+    std::string innerIndexName;
+    for (int side = 0; side < 2; ++side) {
+        std::string indexName;
+        const Index* index = tables[side]->findKeyIndex(keys[side].second, false, indexName);
+        double cost = lookupCost(side, expected[1 - side]);
+        if (!index || cost >= scanned[side] || (inner != -1 && cost >= lookupCost(inner, expected[1 - inner]))) continue;
+        inner = side;
+        innerIndex = index;
+        innerIndexName = indexName;
+    }
+
+    std::vector<std::string> headings;
+    std::vector<std::pair<int, int>> outputs;
+    if (selectColumns.size() == 1 && selectColumns[0] == "*") {
+        for (int side = 0; side < 2; ++side) {
+            for (size_t c = 0; c < tables[side]->columns.size(); ++c) {
+                headings.push_back(names[side] + "." + tables[side]->columns[c].name);
+                outputs.emplace_back(side, static_cast<int>(c));
+            }
+        }
+    } else {
+        for (const auto& column : selectColumns) {
+            headings.push_back(column);
+            outputs.push_back(resolve(column));
+        }
+    }
+
+    std::vector<RowId> rows[2];
+    std::string accessPaths[2];
+    ScanInfo sideScans[2]; // Each side's pipeline, for EXPLAIN
+    bool read[2] = {false, false};
+    auto readSide = [&](int side) {
+        rows[side] = tables[side]->selectRowIds(sideWhere[side]);
+        accessPaths[side] = tables[side]->describeLastScan();
+        sideScans[side] = tables[side]->lastScan;
+        read[side] = true;
+    };
+    JoinInput inputs[2] = {{tables[0]->columnData, keys[0].second, rows[0], names[0]},
+                           {tables[1]->columnData, keys[1].second, rows[1], names[1]}};
+    JoinResult joined;
+    double joinSeconds = 0;
+    auto timeJoin = [&](const std::function<JoinResult()>& join) {
+        auto start = std::chrono::steady_clock::now();
+        joined = join();
+        joinSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    ExplainMode explain = tables[0]->explain;
+    bool done = false;
+    if (inner != -1) {
+        int driver = 1 - inner;
+        readSide(driver);
+        // The estimate may be off; with the driver's actual rows, scanning could still win
+        if (lookupCost(inner, static_cast<double>(rows[driver].size())) < scanned[inner]) {
+            IndexedInput indexed{tables[inner]->columnData, keys[inner].second, *innerIndex, innerIndexName, conditions[inner], names[inner]};
+            timeJoin([&]() { return indexNestedLoopJoin(inputs[driver], indexed, driver == 0, scanThreadsFor(rows[driver].size())); });
+            std::string keyList;
+            for (int column : innerIndex->keyColumns()) {
+                keyList += (keyList.empty() ? "" : ", ") + tables[inner]->columns[column].name;
+            }
+            accessPaths[inner] = "index lookups on '" + innerIndexName + "' (" + keyList + ") per row of '" + names[driver] + "'";
+            if (explain == ExplainMode::PLAN) {
+                joined.method = "index nested-loop join probing '" + innerIndexName + "' of '" + names[inner] + "' for about " +
+                                std::to_string(static_cast<size_t>(expected[driver])) + " row(s) of '" + names[driver] + "'";
+            } else {
+                accessPaths[inner] += ", " + std::to_string(joined.innerRowsExamined) + " row(s) examined";
+            }
+            // The inner side is read by the join itself, through its index
+            OperatorProfile lookups;
+            lookups.name = "Index lookups on '" + innerIndexName + "' (" + keyList + ")";
+            if (!sideWhere[inner].empty()) lookups.name += ", filtering " + conditions[inner].toString();
+            lookups.bytesPerRow = sizeof(RowId) + conditionBytes(conditions[inner], tables[inner]->columnData);
+            lookups.rowsIn = joined.innerRowsExamined;
+            lookups.rowsOut = joined.leftRows.size();
+            lookups.seconds = joinSeconds;
+            sideScans[inner].operators.push_back(std::move(lookups));
+            done = true;
+        }
+    }
+
+    // With ordered indexes on both keys, each side is read in key order and
+    // the two are merged, unless a side filters better through a scan
+    std::string orderedName;
+    if (!done && !read[0] && !read[1] && tables[0]->findKeyIndex(keys[0].second, true, orderedName) &&
+        tables[1]->findKeyIndex(keys[1].second, true, orderedName) &&
+        tables[0]->selectRowIdsInKeyOrder(sideWhere[0], keys[0].second, rows[0])) {
+        accessPaths[0] = tables[0]->describeLastScan();
+        sideScans[0] = tables[0]->lastScan;
+        read[0] = true;
+        if (tables[1]->selectRowIdsInKeyOrder(sideWhere[1], keys[1].second, rows[1])) {
+            accessPaths[1] = tables[1]->describeLastScan();
+            sideScans[1] = tables[1]->lastScan;
+            read[1] = true;
+            timeJoin([&]() { return mergeJoin(inputs[0], inputs[1]); });
+            if (explain == ExplainMode::PLAN) joined.method = "merge join of '" + names[0] + "' and '" + names[1] + "' in key order";
+            done = true;
         } else {
-            selectColumns.push_back(trim(columnName));
-            if (queryStream.peek() == ',') queryStream.ignore();
+            // The hash join takes its rows in row order, as a scan would give them
+            std::sort(rows[0].begin(), rows[0].end());
         }
     }
 
-    std::string fromKeyword, tableName;
-    if (!(queryStream >> fromKeyword) || toLower(fromKeyword) != "from") {
+    if (!done) {
+        for (int side = 0; side < 2; ++side) {
+            if (!read[side]) readSide(side);
+        }
+        timeJoin([&]() { return hashJoin(inputs[0], inputs[1], scanThreadsFor(std::max(rows[0].size(), rows[1].size()))); });
+        if (explain == ExplainMode::PLAN) {
+            int build = expected[0] < expected[1] ? 0 : 1;
+            joined.method = "hash join building on '" + names[build] + "' (about " +
+                            std::to_string(static_cast<size_t>(expected[build])) + " rows)";
+        }
+    }
+
+    if (explain != ExplainMode::OFF) {
+        bool analyze = explain == ExplainMode::ANALYZE;
+        ScanInfo joinScan;
+        OperatorProfile joining;
+        joining.name = "Join: " + joined.method;
+        joining.bytesPerRow = sizeof(RowId) + std::max(valueBytes(keyTypes[0]), valueBytes(keyTypes[1]));
+        joining.rowsIn = rows[0].size() + rows[1].size();
+        joining.rowsOut = joined.leftRows.size();
+        joining.seconds = joinSeconds;
+        joinScan.operators.push_back(std::move(joining));
+        std::cout << "Plan:" << std::endl;
+        printOperators(joinScan, analyze, "  ");
+        for (int side = 0; side < 2; ++side) {
+            std::cout << "      '" << names[side] << "':" << std::endl;
+            printOperators(sideScans[side], analyze, "        ");
+        }
+        std::cout << "Access path (" << names[0] << "): " << accessPaths[0] << std::endl;
+        std::cout << "Access path (" << names[1] << "): " << accessPaths[1] << std::endl;
+        std::cout << "Join: " << joined.method;
+        if (analyze) std::cout << ", " << joined.leftRows.size() << " matching pair(s)";
+        std::cout << std::endl;
+        return;
+    }
+
+    size_t first = std::min(offset, joined.leftRows.size());
+    size_t last = first + std::min(limit, joined.leftRows.size() - first);
+    if (first == last) {
+        std::cout << "No rows selected." << std::endl;
+    } else {
+        auto printBorder = [&]() {
+            std::cout << "+";
+            for (const auto& heading : headings) std::cout << std::string(heading.length() + 2, '-') << "+";
+            std::cout << std::endl;
+        };
+        printBorder();
+        std::cout << "|";
+        for (const auto& heading : headings) std::cout << " " << heading << " |";
+        std::cout << std::endl;
+        printBorder();
+        for (size_t i = first; i < last; ++i) {
+            RowId pair[2] = {joined.leftRows[i], joined.rightRows[i]};
+            std::cout << "|";
+            for (size_t c = 0; c < outputs.size(); ++c) {
+                const Column& column = tables[outputs[c].first]->columnData[outputs[c].second];
+                RowId row = pair[outputs[c].first];
+                std::cout << " " << std::setw(headings[c].length()) << std::left;
+                switch (column.type()) {
+                    case INT: std::cout << column.ints()[row]; break;
+                    case REAL: std::cout << column.reals()[row]; break;
+                    default: std::cout << column.texts()[row]; break;
+                }
+                std::cout << " |";
+            }
+            std::cout << '\n';
+        }
+        printBorder();
+        std::cout << "► " << last - first << " row(s) in set" << std::endl;
+    }
+    std::cout << "Access path (" << names[0] << "): " << accessPaths[0] << std::endl;
+    std::cout << "Access path (" << names[1] << "): " << accessPaths[1] << std::endl;
+    std::cout << "Join: " << joined.method << ", " << joined.leftRows.size() << " matching pair(s)" << std::endl;
+}
+
+void Database::parseSelect(std::istringstream& queryStream) {
+    // The select list runs up to FROM; items are split on the commas outside
+    // parentheses, so "COUNT( * )" and "SUM(v),MAX(v)" both work
+    std::string selectList;
+    std::string columnToken;
+    bool sawFrom = false;
+    while (queryStream >> columnToken) {
+        if (toLower(columnToken) == "from") {
+            sawFrom = true;
+            break;
+        }
+        selectList += " " + columnToken;
+    }
+    std::vector<std::string> selectColumns;
+    int depth = 0;
+    size_t itemStart = 0;
+    for (size_t i = 0; i <= selectList.size(); ++i) {
+        if (i < selectList.size() && selectList[i] == '(') ++depth;
+        if (i < selectList.size() && selectList[i] == ')') --depth;
+        if (i == selectList.size() || (selectList[i] == ',' && depth == 0)) {
+            std::string item = trim(selectList.substr(itemStart, i - itemStart));
+            if (!item.empty()) selectColumns.push_back(item);
+            itemStart = i + 1;
+        }
+    }
+
+    std::string tableName;
+    if (!sawFrom) {
         throw std::runtime_error("Expected FROM keyword after column list in SELECT query");
     }
     if (!(queryStream >> tableName)) {
@@ -727,63 +1974,167 @@ void Database::parseSelect(std::istringstream& queryStream) {
     }
     tableName = trim(tableName);
 
-    std::string whereClause;
-    std::string whereKeyword;
-    if (queryStream >> whereKeyword && toLower(whereKeyword) == "where") {
-        std::getline(queryStream, whereClause);
-        whereClause = trim(whereClause);
-    }
+    std::string tail;
+    std::getline(queryStream, tail);
+    std::map<std::string, std::string> clauses =
+        splitClauses(tail, {"join", "on", "where", "group by", "order by", "limit", "offset"});
+    std::string whereClause = clauses["where"];
+    size_t limit = clauses.count("limit") ? parseRowCount(clauses["limit"], "LIMIT") : NO_LIMIT;
+    size_t offset = clauses.count("offset") ? parseRowCount(clauses["offset"], "OFFSET") : 0;
 
     Table& table = getTable(tableName);
-    std::vector<std::vector<Value>> results;
-    if (selectColumns.size() == 1 && selectColumns[0] == "*") {
-        std::vector<std::string> allColumnNames;
-        for (const auto& colDef : table.columns) {
-            allColumnNames.push_back(colDef.name);
+
+    if (clauses.count("join")) {
+        AggregateFunction function;
+        std::string argument;
+        bool anyAggregate = std::any_of(selectColumns.begin(), selectColumns.end(), [&](const std::string& item) {
+            return parseAggregateCall(item, function, argument);
+        });
+        if (anyAggregate || clauses.count("group by") || clauses.count("order by")) {
+            throw std::runtime_error("Aggregate functions, GROUP BY and ORDER BY are not supported together with JOIN.");
         }
-        results = table.selectRows(allColumnNames, whereClause);
-    } else {
-        results = table.selectRows(selectColumns, whereClause);
+        if (!clauses.count("on")) {
+            throw std::runtime_error("Expected ON with the join condition after JOIN table.");
+        }
+        printJoin(table, clauses[""], clauses["join"], clauses["on"], selectColumns, whereClause, limit, offset);
+        return;
+    }
+    if (clauses.count("on")) {
+        throw std::runtime_error("ON is only allowed after JOIN.");
+    }
+    if (clauses.count("")) {
+        throw std::runtime_error("Unexpected '" + clauses[""] + "' in SELECT query.");
     }
 
-    if (!results.empty()) {
-        std::vector<std::string> headersToPrint = (selectColumns.size() == 1 && selectColumns[0] == "*") ?
-                                                  std::vector<std::string>() : selectColumns;
-        if (headersToPrint.empty()) {
-            table.printTable();
-        } else {
-            std::cout << "+";
-            for (const auto& colName : headersToPrint) {
-                std::cout << std::string(colName.length() + 2, '-') << "+";
+    // ORDER BY col [ASC|DESC], ...; the columns need not be selected
+    std::vector<SortKey> order;
+    if (clauses.count("order by")) {
+        std::istringstream orderStream(clauses["order by"]);
+        std::string item;
+        while (std::getline(orderStream, item, ',')) {
+            std::istringstream itemStream(item);
+            std::string columnName, direction, extra;
+            itemStream >> columnName >> direction >> extra;
+            SortKey key;
+            key.column = table.getColumnIndex(columnName);
+            if (key.column == -1) {
+                throw std::runtime_error("Column '" + columnName + "' in ORDER BY not found in table '" + table.name + "'.");
             }
-            std::cout << std::endl << "|";
-            for (const auto& colName : headersToPrint) {
-                std::cout << " " << colName << " |";
+            direction = toLower(direction);
+            if (!extra.empty() || (!direction.empty() && direction != "asc" && direction != "desc")) {
+                throw std::runtime_error("Expected ASC or DESC after '" + columnName + "' in ORDER BY.");
             }
-            std::cout << std::endl << "+";
-            for (const auto& colName : headersToPrint) {
+            key.descending = direction == "desc";
+            order.push_back(key);
+        }
+    }
+
+    // Aggregates are folded straight from the column arrays into one output row,
+    // or one row per group
+    std::vector<AggregateSpec> aggregates;
+    std::vector<int> aggregateOf(selectColumns.size(), -1);
+    for (size_t i = 0; i < selectColumns.size(); ++i) {
+        AggregateFunction function;
+        std::string argument;
+        if (parseAggregateCall(selectColumns[i], function, argument)) {
+            aggregateOf[i] = static_cast<int>(aggregates.size());
+            aggregates.push_back(table.compileAggregate(function, argument, selectColumns[i]));
+        }
+    }
+    if ((clauses.count("group by") || !aggregates.empty()) && !order.empty()) {
+        throw std::runtime_error("ORDER BY is not supported together with aggregate functions or GROUP BY.");
+    }
+    if (clauses.count("group by")) {
+        printGroups(table, selectColumns, aggregates, aggregateOf, clauses["group by"], whereClause, limit, offset);
+        return;
+    }
+    if (!aggregates.empty()) {
+        if (aggregates.size() != selectColumns.size()) {
+            throw std::runtime_error("Columns cannot be selected together with aggregate functions.");
+        }
+        std::vector<Accumulator> states = table.aggregate(aggregates, whereClause);
+        if (table.explain != ExplainMode::OFF) {
+            printPlan(table);
+            return;
+        }
+        std::vector<std::vector<std::string>> rows(1);
+        for (size_t i = 0; i < aggregates.size(); ++i) rows[0].push_back(states[i].result(aggregates[i]));
+        applyLimit(rows, limit, offset);
+        printResultTable(selectColumns, rows);
+        std::cout << "Access path: " << table.describeLastScan() << std::endl;
+        return;
+    }
+
+    bool selectAll = selectColumns.size() == 1 && selectColumns[0] == "*";
+    if (selectAll) {
+        selectColumns.clear();
+        for (const auto& colDef : table.columns) {
+            selectColumns.push_back(colDef.name);
+        }
+    }
+    Projection projection = table.selectBatches(selectColumns, whereClause, order, limit, offset);
+    ColumnBatch batch;
+    if (table.explain != ExplainMode::OFF) {
+        // ANALYZE reads every row through the pipeline without printing it
+        if (table.explain == ExplainMode::ANALYZE) {
+            OperatorProfile& projected = table.lastScan.operators.back();
+            auto start = std::chrono::steady_clock::now();
+            while (projection.next(batch)) projected.rowsOut += batch.count;
+            projected.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            table.lastScan.rowsMatched = projected.rowsOut;
+        }
+        printPlan(table);
+        return;
+    }
+    size_t rowsPrinted = 0;
+
+    if (!projection.next(batch)) {
+        std::cout << "No rows selected." << std::endl;
+    } else if (selectAll && whereClause.empty() && order.empty() && limit == NO_LIMIT && offset == 0) {
+        table.printTable();
+        rowsPrinted = table.liveRowCount();
+    } else {
+        auto printBorder = [&]() {
+            std::cout << "+";
+            for (const auto& colName : selectColumns) {
                 std::cout << std::string(colName.length() + 2, '-') << "+";
             }
             std::cout << std::endl;
+        };
+        printBorder();
+        std::cout << "|";
+        for (const auto& colName : selectColumns) {
+            std::cout << " " << colName << " |";
+        }
+        std::cout << std::endl;
+        printBorder();
 
-            for (const auto& row : results) {
+        // Values are printed straight from the typed batch arrays, a batch at a time
+        do {
+            for (size_t i = 0; i < batch.count; ++i) {
                 std::cout << "|";
-                for (const auto& val : row) {
-                    std::stringstream ss;
-                    ss << val;
-                    std::cout << " " << std::setw(headersToPrint[(&val - &row[0])].length()) << std::left << ss.str() << " |";
+                for (size_t c = 0; c < batch.columns.size(); ++c) {
+                    const Column& column = batch.columns[c];
+                    std::cout << " " << std::setw(selectColumns[c].length()) << std::left;
+                    switch (column.type()) {
+                        case INT: std::cout << column.ints()[i]; break;
+                        case REAL: std::cout << column.reals()[i]; break;
+                        default: std::cout << column.texts()[i]; break;
+                    }
+                    std::cout << " |";
                 }
-                std::cout << std::endl;
-            }
-            std::cout << "+";
-            for (const auto& colName : headersToPrint) {
-                std::cout << std::string(colName.length() + 2, '-') << "+";
+                std::cout << '\n';
             }
-            std::cout << std::endl;
-            std::cout << "► " << results.size() << " row(s) in set" << std::endl;
-        }
-    } else {
-        std::cout << "No rows selected." << std::endl;
+            rowsPrinted += batch.count;
+        } while (projection.next(batch));
+
+        printBorder();
+        std::cout << "► " << rowsPrinted << " row(s) in set" << std::endl;
+    }
+    table.lastScan.rowsMatched = rowsPrinted;
+    std::cout << "Access path: " << table.describeLastScan() << std::endl;
+    if (!table.lastScan.ordering.empty()) {
+        std::cout << "Ordering: " << table.lastScan.ordering << std::endl;
     }
 }
 
@@ -805,7 +2156,7 @@ void Database::parseUpdate(std::istringstream& queryStream) {
 
     Table& table = getTable(tableName);
     table.updateRows(setClause, whereClause);
-    std::cout << "Rows updated in table '" << tableName << "'" << std::endl;
+    std::cout << "Rows updated in table '" << tableName << "' (" << table.describeLastScan() << ")" << std::endl;
 }
 
 void Database::parseDelete(std::istringstream& queryStream) {
@@ -822,7 +2173,84 @@ void Database::parseDelete(std::istringstream& queryStream) {
 
     Table& table = getTable(tableName);
     table.deleteRows(whereClause);
-    std::cout << "Rows deleted from table '" << tableName << "'" << std::endl;
+    std::cout << "Rows deleted from table '" << tableName << "' (" << table.describeLastScan() << ")" << std::endl;
+}
+
+// EXPLAIN [ANALYZE] SELECT ...: plans the query, and with ANALYZE runs it and reports each operator
+void Database::parseExplain(std::istringstream& queryStream) {
+    std::string word;
+    queryStream >> word;
+    ExplainMode mode = ExplainMode::PLAN;
+    if (toLower(word) == "analyze") {
+        mode = ExplainMode::ANALYZE;
+        queryStream >> word;
+    }
+    if (toLower(word) != "select") {
+        throw std::runtime_error("EXPLAIN supports SELECT queries only.");
+    }
+    // Any table the query touches may be planned under the mode, so every
+    // table gets it until the query ends, by an error too
+    auto setMode = [&](ExplainMode tableMode) {
+        for (auto& [tableName, table] : tables) table.explain = tableMode;
+    };
+    setMode(mode);
+    auto start = std::chrono::steady_clock::now();
+    try {
+        parseSelect(queryStream);
+    } catch (...) {
+        setMode(ExplainMode::OFF);
+        throw;
+    }
+    setMode(ExplainMode::OFF);
+    if (mode == ExplainMode::ANALYZE) {
+        std::cout << "Execution time: " << formatMilliseconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+                  << std::endl;
+    }
+}
+
+// SET threads = N: threads a scan may use; 0 restores one per core
+// SET sort_memory = MB: working memory of a sort before it spills runs to disk
+void Database::parseSet(std::istringstream& queryStream) {
+    std::string assignment;
+    std::getline(queryStream, assignment);
+    size_t equals = assignment.find('=');
+    if (equals == std::string::npos) {
+        throw std::runtime_error("Invalid SET syntax. Expected: SET threads = N or SET sort_memory = MB");
+    }
+    std::string setting = toLower(trim(assignment.substr(0, equals)));
+    std::string valueText = trim(assignment.substr(equals + 1));
+    if (setting == "sort_memory") {
+        size_t consumed = 0;
+        long megabytes = 0;
+        try {
+            megabytes = std::stol(valueText, &consumed);
+        } catch (const std::exception&) {
+        }
+        if (megabytes <= 0 || consumed != valueText.size()) {
+            throw std::runtime_error("Invalid sort memory '" + valueText + "'. Expected a positive number of megabytes.");
+        }
+        setSortMemory(static_cast<size_t>(megabytes) << 20);
+        std::cout << "Sorts spill to disk beyond " << megabytes << " MB." << std::endl;
+        return;
+    }
+    if (setting != "threads") {
+        throw std::runtime_error("Unknown setting '" + trim(assignment.substr(0, equals)) + "'.");
+    }
+    size_t consumed = 0;
+    int threads = -1;
+    try {
+        threads = std::stoi(valueText, &consumed);
+    } catch (const std::exception&) {
+    }
+    if (threads < 0 || consumed != valueText.size()) {
+        throw std::runtime_error("Invalid thread count '" + valueText + "'. Expected a number, or 0 for one per core.");
+    }
+    setScanThreads(static_cast<size_t>(threads));
+    if (threads == 0) {
+        std::cout << "Scans use up to " << ThreadPool::shared().size() << " thread(s), one per core." << std::endl;
+    } else {
+        std::cout << "Scans use up to " << std::min<size_t>(threads, ThreadPool::shared().size() + 1) << " thread(s)." << std::endl;
+    }
 }
 
 void Database::parseCreateIndex(std::istringstream& queryStream) {
@@ -834,13 +2262,40 @@ void Database::parseCreateIndex(std::istringstream& queryStream) {
 
     std::getline(queryStream, columnsPart);
     columnsPart = trim(columnsPart);
-    if (columnsPart.front() != '(' || columnsPart.back() != ')') {
+
+    size_t open = columnsPart.find('(');
+    size_t close = columnsPart.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
         throw std::runtime_error("Expected column list in parentheses for CREATE INDEX on '" + tableName + "'.");
     }
-    std::string columnName = trim(columnsPart.substr(1, columnsPart.length() - 2));
+    std::vector<std::string> columnNames;
+    std::istringstream columnStream(columnsPart.substr(open + 1, close - open - 1));
+    std::string columnName;
+    while (std::getline(columnStream, columnName, ',')) {
+        columnName = trim(columnName);
+        if (columnName.empty()) {
+            throw std::runtime_error("Empty column name in CREATE INDEX column list.");
+        }
+        columnNames.push_back(columnName);
+    }
+    if (columnNames.empty()) {
+        throw std::runtime_error("CREATE INDEX needs at least one column.");
+    }
+
+    // USING BTREE|HASH may come before the column list (as in PostgreSQL) or after it
+    std::string kind = "BTREE";
+    std::istringstream usingClause(columnsPart.substr(0, open) + " " + columnsPart.substr(close + 1));
+    std::string keyword, method, extra;
+    if (usingClause >> keyword) {
+        if (toLower(keyword) != "using" || !(usingClause >> method) || (usingClause >> extra)) {
+            throw std::runtime_error("Invalid CREATE INDEX syntax. Expected USING BTREE or USING HASH.");
+        }
+        std::transform(method.begin(), method.end(), method.begin(), ::toupper);
+        kind = method;
+    }
 
     Table& table = getTable(tableName);
-    table.createIndex(columnName);
+    table.createIndex(indexName, columnNames, kind);
 }
 
 // Include NLP processor and config reader after all HexaDB definitions
@@ -859,19 +2314,40 @@ int main() {
     }
     NLPProcessor nlp(apiKey, db);
 
-    try {
-        db.loadDatabase(dbFilename);
-    } catch (const std::runtime_error& error) {
-        std::cerr << "Warning: Could not load database from file. Starting with a new database. Error: " << error.what() << std::endl;
+    // WAL_FILE=off disables the log and restores snapshot-only persistence
+    std::string walFile = ConfigReader::getValue("WAL_FILE", "hexadb.wal");
+    if (walFile.empty() || db.toLower(walFile) == "off") {
+        try {
+            db.loadDatabase(dbFilename);
+        } catch (const std::runtime_error& error) {
+            std::cerr << "Warning: Could not load database from file. Starting with a new database. Error: " << error.what() << std::endl;
+        }
+    } else {
+        try {
+            WriteAheadLog::Options walOptions;
+            walOptions.groupCommitMs = std::stoul(ConfigReader::getValue("WAL_GROUP_COMMIT_MS", "10"));
+            walOptions.groupCommitRecords = std::stoul(ConfigReader::getValue("WAL_GROUP_COMMIT_RECORDS", "64"));
+            db.recover(dbFilename, walFile, walOptions);
+        } catch (const std::exception& error) {
+            std::cerr << Colors::RED << "Error: Recovery from write-ahead log failed: " << error.what() << Colors::RESET << std::endl;
+            return 1;
+        }
     }
 
     std::cout << "Welcome to HexaDB Terminal" << std::endl;
     std::cout << "Type 'help' for commands, 'exit' to quit, or 'NLP <query>' for natural language queries." << std::endl;
 
+    BackgroundSaver saver(db);
     std::string command;
     while (true) {
+        std::string finished = saver.takeCompletion();
+        if (!finished.empty()) {
+            std::cout << Colors::GREEN << finished << Colors::RESET << std::endl;
+        }
         std::cout << "HexaDB> ";
-        std::getline(std::cin, command);
+        if (!std::getline(std::cin, command)) {
+            break; // End of input
+        }
         std::string trimmedCommand = db.trim(command);
 
         if (trimmedCommand == "exit") {
@@ -889,15 +2365,23 @@ int main() {
             std::cout << Colors::BOLD << "Table Operations:" << Colors::RESET << std::endl;
             std::cout << Colors::BLUE << "  CREATE TABLE" << Colors::RESET << " table_name (column1_name data_type, ...)" << std::endl;
             std::cout << Colors::BLUE << "  INSERT INTO" << Colors::RESET << " table_name (columns) VALUES (values)" << std::endl;
-            std::cout << Colors::BLUE << "  SELECT" << Colors::RESET << " columns FROM table_name [WHERE condition]" << std::endl;
+            std::cout << Colors::BLUE << "  SELECT" << Colors::RESET << " columns FROM table_name [WHERE condition] [ORDER BY column [ASC|DESC], ...] [LIMIT n [OFFSET m]]" << std::endl;
+            std::cout << Colors::BLUE << "  SELECT" << Colors::RESET << " columns FROM table_a [alias] JOIN table_b [alias] ON a.column = b.column [WHERE condition] [LIMIT n [OFFSET m]]" << std::endl;
+            std::cout << Colors::BLUE << "  SELECT" << Colors::RESET << " COUNT(*) | SUM|AVG|MIN|MAX(column), ... FROM table_name [WHERE condition] [GROUP BY columns]" << std::endl;
+            std::cout << Colors::BLUE << "  EXPLAIN" << Colors::RESET << " [ANALYZE] SELECT ... - Show the query plan; ANALYZE runs it and times every operator" << std::endl;
             std::cout << Colors::BLUE << "  UPDATE" << Colors::RESET << " table_name SET column = value [WHERE condition]" << std::endl;
             std::cout << Colors::BLUE << "  DELETE FROM" << Colors::RESET << " table_name [WHERE condition]\n" << std::endl;
 
             // Database Management
             std::cout << Colors::BOLD << "Database Management:" << Colors::RESET << std::endl;
-            std::cout << Colors::MAGENTA << "  CREATE INDEX" << Colors::RESET << " index_name ON table_name (column)" << std::endl;
+            std::cout << Colors::MAGENTA << "  CREATE INDEX" << Colors::RESET << " index_name ON table_name (column, ...) [USING BTREE|HASH]" << std::endl;
             std::cout << Colors::MAGENTA << "  PRINT TABLE" << Colors::RESET << " table_name" << std::endl;
+            std::cout << Colors::MAGENTA << "  VACUUM" << Colors::RESET << " table_name - Reclaim space held by deleted rows" << std::endl;
+            std::cout << Colors::MAGENTA << "  SET threads" << Colors::RESET << " = N - Threads a scan may use (0 = one per core)" << std::endl;
+            std::cout << Colors::MAGENTA << "  SET sort_memory" << Colors::RESET << " = MB - Memory a sort may use before spilling to disk" << std::endl;
             std::cout << Colors::MAGENTA << "  SAVE DB" << Colors::RESET << " [filename] - Save database to file" << std::endl;
+            std::cout << Colors::MAGENTA << "  BGSAVE" << Colors::RESET << " [filename] - Save database in the background" << std::endl;
+            std::cout << Colors::MAGENTA << "  SAVE STATUS" << Colors::RESET << " - Show progress of the background save" << std::endl;
             std::cout << Colors::MAGENTA << "  LOAD DB" << Colors::RESET << " [filename] - Load database from file\n" << std::endl;
 
             // Data Types
@@ -918,6 +2402,19 @@ int main() {
             } catch (const std::runtime_error& error) {
                 std::cerr << "Error: " << error.what() << std::endl;
             }
+        } else if (trimmedCommand == "SAVE STATUS") {
+            std::cout << saver.status() << std::endl;
+        } else if (trimmedCommand.substr(0, 6) == "BGSAVE") {
+            std::string filename = db.trim(trimmedCommand.substr(6));
+            try {
+                saver.start(filename.empty() ? dbFilename : filename);
+                std::cout << "Background save to '" << (filename.empty() ? dbFilename : filename)
+                          << "' started. Use SAVE STATUS to follow it." << std::endl;
+            } catch (const std::runtime_error& error) {
+                std::cerr << "Error saving database: " << error.what() << std::endl;
+            }
+        } else if (saver.running() && (trimmedCommand.substr(0, 7) == "SAVE DB" || trimmedCommand.substr(0, 7) == "LOAD DB")) {
+            std::cerr << "Error: A background save is running. Wait for it to finish (see SAVE STATUS)." << std::endl;
         } else if (trimmedCommand.substr(0, 7) == "SAVE DB") {
             std::string filename = db.trim(trimmedCommand.substr(7));
             try {
@@ -7,9 +7,19 @@
 #include <sstream>
 #include <fstream>
 #include <map>
+#include <deque>
 #include <variant>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
+#include <optional>
+#include "aggregate.h"
+#include "column.h"
+#include "exec.h"
+#include "index.h"
+#include "join.h"
+#include "predicate.h"
+#include "wal.h"
 
 // Color constants for formatted output (declarations only)
 namespace Colors {
@@ -23,20 +33,21 @@ namespace Colors {
     extern const std::string BOLD;
 }
 
-// Supported data types
-enum DataType {
-    INT,
-    TEXT,
-    REAL
-};
-
 std::ostream& operator<<(std::ostream& os, const DataType& dt);
 
-// Type alias for values in a row
-using Value = std::variant<int, std::string, double>;
-
 std::ostream& operator<<(std::ostream& os, const Value& val);
 
+// Records how the most recent WHERE evaluation located its rows
+struct ScanInfo {
+    std::string accessPath;
+    size_t rowsExamined = 0;
+    size_t rowsMatched = 0;
+    std::string aggregation; // How GROUP BY combined the rows, when there was one
+    std::string ordering;    // How ORDER BY put the rows in order, when there was one
+    size_t rowsExpected = 0; // Estimated matches, shown under EXPLAIN, which reads no rows
+    std::deque<OperatorProfile> operators; // The pipeline from its access path up, for EXPLAIN
+};
+
 struct ColumnDefinition {
     std::string name;
     DataType dataType;
@@ -48,22 +59,92 @@ class Table {
 public:
     std::string name;
     std::vector<ColumnDefinition> columns;
-    std::vector<std::vector<Value>> rows;
-    std::map<std::string, std::map<Value, std::vector<int>>> indexes;
+    std::vector<Column> columnData; // One typed array per column definition
+    std::vector<bool> deleted;      // Tombstones; set bits are skipped by scans until VACUUM
+    size_t deletedCount = 0;
+    std::map<std::string, std::unique_ptr<Index>> indexes; // Keyed by index name
+    ScanInfo lastScan;
+    ExplainMode explain = ExplainMode::OFF; // Set while a statement runs under EXPLAIN
 
     Table(std::string tableName);
     void addColumn(const ColumnDefinition& colDef);
     void insertRow(const std::vector<Value>& rowValues);
-    void createIndex(const std::string& columnName);
+    void createIndex(const std::string& indexName, const std::vector<std::string>& columnNames, const std::string& kind = "BTREE");
+    // Ids of the live rows matching whereClause, in row order
+    std::vector<RowId> selectRowIds(const std::string& whereClause = "");
+    // Ids of the live rows matching whereClause in ascending order of column,
+    // read out of an ordered index whose first key column it is. Returns false,
+    // leaving rows alone, when there is no such index or filtering first is
+    // expected to read fewer rows.
+    bool selectRowIdsInKeyOrder(const std::string& whereClause, int column, std::vector<RowId>& rows);
+    // The index a join can probe with a single value of column: a HASH index on
+    // the column alone, else the BTREE with the fewest key columns that starts
+    // with it (only BTREEs when ordered is set). Null when there is none.
+    const Index* findKeyIndex(int column, bool ordered, std::string& indexName) const;
     std::vector<std::vector<Value>> selectRows(const std::vector<std::string>& selectedColumns, const std::string& whereClause = "");
+    // Streams the selected columns of the rows matching whereClause, one batch
+    // at a time: in table order, or in the order of the sort keys when given,
+    // skipping the first offset rows and ending after limit rows
+    Projection selectBatches(const std::vector<std::string>& selectedColumns, const std::string& whereClause = "",
+                             const std::vector<SortKey>& order = {}, size_t limit = NO_LIMIT, size_t offset = 0);
+    // Resolves the argument of an aggregate call against the schema; "*" is
+    // only allowed for COUNT, and SUM and AVG need a numeric column
+    AggregateSpec compileAggregate(AggregateFunction function, const std::string& argument, const std::string& label) const;
+    // Folds the rows matching whereClause into one state per aggregate
+    std::vector<Accumulator> aggregate(const std::vector<AggregateSpec>& specs, const std::string& whereClause = "");
+    // GROUP BY: folds the rows matching whereClause into one group per distinct
+    // combination of the key columns. Groups are hashed unless the estimated
+    // group count exceeds HASH_AGGREGATION_MAX_GROUPS, in which case they are sorted.
+    GroupedResult aggregateGroups(const std::vector<int>& keyColumns, const std::vector<AggregateSpec>& specs,
+                                  const std::string& whereClause = "");
     void updateRows(const std::string& setClause, const std::string& whereClause = "");
     void deleteRows(const std::string& whereClause = "");
     void printTable() const;
+    // Drops tombstoned rows from the columns and renumbers index entries
+    void vacuum();
+
+    size_t rowCount() const;     // Physical rows, including tombstoned ones
+    size_t liveRowCount() const;
+    bool isDeleted(size_t row) const { return deleted[row]; }
+    Value getValue(size_t row, size_t col) const;
+    std::vector<Value> getRow(size_t row) const;
 
     int getColumnIndex(const std::string& columnName) const;
     std::string trim(const std::string& str) const;
+    std::string describeLastScan() const;
+    // Parses a WHERE clause once against this table's schema into a tree of
+    // comparisons joined by AND and OR, with parentheses for grouping. An empty
+    // clause yields an AND without children, which every row satisfies.
+    Condition compileWhere(const std::string& whereClause) const;
+    // Compiles whereClause and orders its terms by their selectivity on a
+    // sample of the table, as a scan would evaluate them
+    Condition planWhere(const std::string& whereClause) const;
 
 private:
+    // Plans a pipeline producing the live rows that satisfy the condition, in
+    // row order, and records its access path in lastScan. foldsRows is set by
+    // consumers that fold rows into per-morsel state through
+    // ParallelScan::forEachBatch, for which even an unfiltered scan is worth
+    // running in parallel. stopsEarly is set by consumers that may stop pulling
+    // batches before the end (LIMIT); a full scan then reads the table lazily
+    // and counts only the rows it actually read as examined.
+    std::unique_ptr<BatchSource> planScan(Condition where, bool foldsRows = false, bool stopsEarly = false);
+    // Plans reading the rows that satisfy the condition straight out of an
+    // ordered index whose leading key columns are the sort keys, all in the
+    // same direction, so no sort is needed. Only the first needed rows are
+    // read. Returns null when no index fits or filtering first and sorting
+    // is expected to read fewer rows.
+    std::unique_ptr<BatchSource> planIndexOrder(Condition& where, const std::vector<SortKey>& order, size_t needed);
+    // Records a pipeline operator in lastScan.operators and, under EXPLAIN
+    // ANALYZE, wraps it so that its rows and time are counted there
+    std::unique_ptr<BatchSource> addStage(std::unique_ptr<BatchSource> stage, std::string stageName, size_t bytesPerRow);
+    std::vector<size_t> findMatchingRows(Condition where);
+    Condition compileCondition(const std::string& clause) const;
+    Predicate compileComparison(const std::string& clause) const;
+    // Up to SELECTIVITY_SAMPLE_ROWS live rows spread evenly over the table
+    std::vector<RowId> sampleRows() const;
+    // Distinct combinations of the key columns among the live rows, estimated from a sample
+    size_t estimateDistinct(const std::vector<int>& keyColumns) const;
     std::string dataTypeToString(DataType dt) const;
     std::string toLower(std::string str) const;
 };
@@ -72,6 +153,7 @@ class Database {
 public:
     std::string name;
     std::map<std::string, Table> tables;
+    std::unique_ptr<WriteAheadLog> wal; // Redo log of changes since the last snapshot, when enabled
 
     Database(std::string dbName);
     void createTable(const std::string& tableName, const std::vector<ColumnDefinition>& colDefs);
@@ -79,16 +161,34 @@ public:
     void executeQuery(const std::string& sqlQuery);
     void saveDatabase(const std::string& filename) const;
     void loadDatabase(const std::string& filename);
+    // Loads the snapshot the log is based on (defaultSnapshot for a new log),
+    // replays the logged statements and keeps logging to walPath afterwards
+    void recover(const std::string& defaultSnapshot, const std::string& walPath, const WriteAheadLog::Options& options);
     std::string trim(const std::string& str) const;
     std::string toLower(std::string str) const;
+    std::string toUpper(std::string str) const;
 
 private:
+    bool replaying = false;
+
+    std::map<std::string, std::string> splitClauses(const std::string& tail, const std::vector<std::string>& keywords) const;
+    void printGroups(Table& table, const std::vector<std::string>& selectColumns,
+                     const std::vector<AggregateSpec>& aggregates, const std::vector<int>& aggregateOf,
+                     const std::string& groupClause, const std::string& whereClause, size_t limit, size_t offset);
+    void printJoin(Table& leftTable, const std::string& leftAlias, const std::string& joinClause,
+                   const std::string& onClause, const std::vector<std::string>& selectColumns,
+                   const std::string& whereClause, size_t limit, size_t offset);
+
     void parseCreateTable(std::istringstream& queryStream);
     void parseInsert(std::istringstream& queryStream);
     void parseSelect(std::istringstream& queryStream);
     void parseUpdate(std::istringstream& queryStream);
     void parseDelete(std::istringstream& queryStream);
     void parseCreateIndex(std::istringstream& queryStream);
+    void parseSet(std::istringstream& queryStream);
+    // EXPLAIN [ANALYZE] SELECT ...: prints the plan of the query in place of
+    // its rows; ANALYZE runs it first and shows what every operator did
+    void parseExplain(std::istringstream& queryStream);
 };
 
 #endif // HEXADB_H
\ No newline at end of file
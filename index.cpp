@@ -0,0 +1,498 @@
+#include "index.h"
+#include "exec.h"
+#include "hash_table.h"
+#include "parallel_sort.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Maps a DataType to the typed array a Column keeps for it
+template <typename K> const std::vector<K>& columnValues(const Column& column);
+template <> const std::vector<int32_t>& columnValues<int32_t>(const Column& column) { return column.ints(); }
+template <> const std::vector<double>& columnValues<double>(const Column& column) { return column.reals(); }
+template <> const std::vector<std::string>& columnValues<std::string>(const Column& column) { return column.texts(); }
+
+template <typename K> K keyOf(const Value& value);
+template <> int32_t keyOf<int32_t>(const Value& value) { return std::get<int>(value); }
+template <> double keyOf<double>(const Value& value) { return std::get<double>(value); }
+template <> std::string keyOf<std::string>(const Value& value) { return std::get<std::string>(value); }
+
+void appendBigEndian(std::string& out, uint64_t bits, size_t bytes) {
+    for (size_t i = bytes; i-- > 0;) {
+        out.push_back(static_cast<char>((bits >> (i * 8)) & 0xFF));
+    }
+}
+
+// Composite keys are encoded so that comparing the byte strings orders them
+// like comparing the values column by column. Every part is self-delimiting,
+// so a key prefix is also a byte prefix.
+//   INT   4 bytes big-endian with the sign bit flipped
+//   REAL  8 bytes big-endian; sign bit flipped for positives, all bits for negatives
+//   TEXT  bytes with 0x00 escaped as 0x00 0xFF, then the terminator 0x00 0x01
+void appendInt(std::string& out, int32_t value) {
+    appendBigEndian(out, static_cast<uint32_t>(value) ^ 0x80000000u, 4);
+}
+
+void appendReal(std::string& out, double value) {
+    if (value == 0.0) value = 0.0; // -0.0 == 0.0
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits = (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+    appendBigEndian(out, bits, 8);
+}
+
+void appendText(std::string& out, const std::string& value) {
+    for (char c : value) {
+        out.push_back(c);
+        if (c == '\0') out.push_back('\xFF');
+    }
+    out.push_back('\0');
+    out.push_back('\x01');
+}
+
+void appendKeyPart(std::string& out, DataType type, const Value& value) {
+    switch (type) {
+        case INT: appendInt(out, std::get<int>(value)); break;
+        case REAL: appendReal(out, std::get<double>(value)); break;
+        default: appendText(out, std::get<std::string>(value)); break;
+    }
+}
+
+void appendKeyPart(std::string& out, const Column& column, size_t row) {
+    switch (column.type()) {
+        case INT: appendInt(out, column.ints()[row]); break;
+        case REAL: appendReal(out, column.reals()[row]); break;
+        default: appendText(out, column.texts()[row]); break;
+    }
+}
+
+bool startsWith(const std::string& key, const std::string& prefix) {
+    return key.compare(0, prefix.size(), prefix) == 0;
+}
+
+// (key, row) entries of the live rows in row order. Large tables are read in
+// morsels on the shared pool: each morsel counts its live rows, then fills its
+// slice of the output.
+template <typename K, typename KeyAt>
+std::vector<std::pair<K, RowId>> liveEntries(const std::vector<bool>& deleted, KeyAt keyAt, size_t threads) {
+    size_t morsels = (deleted.size() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+    std::vector<size_t> offsets(morsels + 1, 0);
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(morsels, [&](size_t m) {
+        size_t end = std::min(deleted.size(), (m + 1) * MORSEL_ROWS);
+        for (size_t i = m * MORSEL_ROWS; i < end; ++i) offsets[m + 1] += !deleted[i];
+    }, threads);
+    for (size_t m = 0; m < morsels; ++m) offsets[m + 1] += offsets[m];
+
+    std::vector<std::pair<K, RowId>> entries(offsets[morsels]);
+    pool.parallelFor(morsels, [&](size_t m) {
+        size_t out = offsets[m];
+        size_t end = std::min(deleted.size(), (m + 1) * MORSEL_ROWS);
+        for (size_t i = m * MORSEL_ROWS; i < end; ++i) {
+            if (!deleted[i]) entries[out++] = {keyAt(static_cast<RowId>(i)), static_cast<RowId>(i)};
+        }
+    }, threads);
+    return entries;
+}
+
+// Walks a B+tree forwards or backwards until visit returns false
+template <typename K>
+void visitTree(const BPlusTree<K>& tree, bool descending, const std::function<bool(RowId)>& visit) {
+    if (descending) {
+        for (auto cursor = tree.last(); cursor.valid() && visit(cursor.row()); cursor.prev()) {}
+    } else {
+        for (auto cursor = tree.begin(); cursor.valid() && visit(cursor.row()); cursor.next()) {}
+    }
+}
+
+// Single-column B+tree keyed by the column's own type
+template <typename K>
+class OrderedIndex : public Index {
+public:
+    using Index::Index;
+
+    std::string kind() const override { return "BTREE"; }
+    size_t size() const override { return tree.size(); }
+    void clear() override { tree.clear(); }
+
+    void insert(const std::vector<Column>& data, RowId row) override {
+        tree.insert(keyAt(data, row), row);
+    }
+
+    bool erase(const std::vector<Column>& data, RowId row) override {
+        return tree.erase(keyAt(data, row), row);
+    }
+
+    bool supports(const IndexProbe& probe) const override {
+        if (probe.hasRange()) return probe.equal.empty();
+        return probe.equal.size() == 1;
+    }
+
+    void lookup(const IndexProbe& probe, std::vector<RowId>& out) const override {
+        // An equality is the window from the key to itself
+        RangeBound equalTo;
+        if (!probe.hasRange()) equalTo = RangeBound{true, true, probe.equal.at(0)};
+        const RangeBound& lower = probe.hasRange() ? probe.lower : equalTo;
+        const RangeBound& upper = probe.hasRange() ? probe.upper : equalTo;
+
+        // One seek to the lower bound, then a walk that stops past the upper one
+        typename BPlusTree<K>::Cursor cursor = tree.begin();
+        if (lower.set) {
+            K low = keyOf<K>(lower.value);
+            cursor = lower.inclusive ? tree.seek(low) : tree.seekAfter(low);
+        }
+        if (!upper.set) {
+            for (; cursor.valid(); cursor.next()) out.push_back(cursor.row());
+            return;
+        }
+        K high = keyOf<K>(upper.value);
+        for (; cursor.valid(); cursor.next()) {
+            const K& current = cursor.key();
+            if (upper.inclusive ? high < current : !(current < high)) break;
+            out.push_back(cursor.row());
+        }
+    }
+
+    void build(const std::vector<Column>& data, const std::vector<bool>& deleted) override {
+        const std::vector<K>& values = columnValues<K>(data[keyColumns()[0]]);
+        size_t threads = scanThreadsFor(values.size());
+        auto entries = liveEntries<K>(deleted, [&](RowId row) { return values[row]; }, threads);
+        parallelSort(entries, threads);
+        tree.bulkLoad(std::move(entries));
+    }
+
+    void remap(const std::vector<RowId>& newRowIds) override {
+        // Order-preserving renumbering keeps (key, row) order, so no re-sort is needed
+        std::vector<std::pair<K, RowId>> entries;
+        entries.reserve(tree.size());
+        for (auto cursor = tree.begin(); cursor.valid(); cursor.next()) {
+            RowId newRow = newRowIds[cursor.row()];
+            if (newRow != INVALID_ROW) entries.emplace_back(cursor.key(), newRow);
+        }
+        tree.bulkLoad(std::move(entries));
+    }
+
+    bool firstRow(RowId& row) const override {
+        auto cursor = tree.begin();
+        if (cursor.valid()) row = cursor.row();
+        return cursor.valid();
+    }
+
+    bool lastRow(RowId& row) const override {
+        auto cursor = tree.last();
+        if (cursor.valid()) row = cursor.row();
+        return cursor.valid();
+    }
+
+    void visitKeyOrder(bool descending, const std::function<bool(RowId)>& visit) const override {
+        visitTree(tree, descending, visit);
+    }
+
+    bool keepsOrder() const override { return true; }
+
+    void keyOrder(std::vector<RowId>& out) const override {
+        out.reserve(out.size() + tree.size());
+        for (auto cursor = tree.begin(); cursor.valid(); cursor.next()) {
+            out.push_back(cursor.row());
+        }
+    }
+
+    bool buildFromOrder(const std::vector<Column>& data, const RowId* rows, size_t count) override {
+        const std::vector<K>& values = columnValues<K>(data[keyColumns()[0]]);
+        std::vector<std::pair<K, RowId>> entries;
+        entries.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (rows[i] >= values.size()) return false;
+            entries.emplace_back(values[rows[i]], rows[i]);
+            if (i > 0 && !(entries[i - 1] < entries[i])) return false;
+        }
+        tree.bulkLoad(std::move(entries));
+        return true;
+    }
+
+private:
+    BPlusTree<K> tree;
+
+    const K& keyAt(const std::vector<Column>& data, RowId row) const {
+        return columnValues<K>(data[keyColumns()[0]])[row];
+    }
+};
+
+// Single-column hash index keyed by the column's own type
+template <typename K>
+class HashIndex : public Index {
+public:
+    using Index::Index;
+
+    std::string kind() const override { return "HASH"; }
+    size_t size() const override { return map.size(); }
+    void clear() override { map.clear(); }
+
+    void insert(const std::vector<Column>& data, RowId row) override {
+        map.insert(columnValues<K>(data[keyColumns()[0]])[row], row);
+    }
+
+    bool erase(const std::vector<Column>& data, RowId row) override {
+        return map.erase(columnValues<K>(data[keyColumns()[0]])[row], row);
+    }
+
+    bool supports(const IndexProbe& probe) const override {
+        return !probe.hasRange() && probe.equal.size() == 1;
+    }
+
+    void lookup(const IndexProbe& probe, std::vector<RowId>& out) const override {
+        if (!supports(probe)) {
+            throw std::runtime_error("Lookup not supported by hash index.");
+        }
+        auto rows = map.find(keyOf<K>(probe.equal[0]));
+        out.insert(out.end(), rows.begin(), rows.end());
+    }
+
+    void build(const std::vector<Column>& data, const std::vector<bool>& deleted) override {
+        map.build(columnValues<K>(data[keyColumns()[0]]), deleted);
+    }
+
+    void remap(const std::vector<RowId>& newRowIds) override {
+        map.renumber(newRowIds, INVALID_ROW);
+    }
+
+private:
+    FlatHashMultimap<K> map;
+};
+
+// Shared by the multi-column indexes: builds encoded keys from rows and probes
+class CompositeKey {
+public:
+    CompositeKey(const std::vector<int>& columns, const std::vector<DataType>& types)
+        : columns(columns), types(types) {}
+
+    std::string ofRow(const std::vector<Column>& data, RowId row) const {
+        std::string key;
+        for (int column : columns) appendKeyPart(key, data[column], row);
+        return key;
+    }
+
+    // Encoded equality prefix of a probe
+    std::string prefixOf(const IndexProbe& probe) const {
+        std::string key;
+        for (size_t i = 0; i < probe.equal.size(); ++i) appendKeyPart(key, types[i], probe.equal[i]);
+        return key;
+    }
+
+    // Encoded key of a range bound on the column after the equality prefix
+    std::string boundOf(const IndexProbe& probe, const std::string& prefix, const RangeBound& bound) const {
+        std::string key = prefix;
+        appendKeyPart(key, types[probe.equal.size()], bound.value);
+        return key;
+    }
+
+private:
+    std::vector<int> columns;
+    std::vector<DataType> types;
+};
+
+// Multi-column B+tree over encoded keys; answers equality on any key prefix,
+// optionally followed by a range on the next key column
+class CompositeOrderedIndex : public Index {
+public:
+    CompositeOrderedIndex(const std::vector<int>& columns, const std::vector<DataType>& types)
+        : Index(columns), encoder(columns, types) {}
+
+    std::string kind() const override { return "BTREE"; }
+    size_t size() const override { return tree.size(); }
+    void clear() override { tree.clear(); }
+
+    void insert(const std::vector<Column>& data, RowId row) override {
+        tree.insert(encoder.ofRow(data, row), row);
+    }
+
+    bool erase(const std::vector<Column>& data, RowId row) override {
+        return tree.erase(encoder.ofRow(data, row), row);
+    }
+
+    bool supports(const IndexProbe& probe) const override {
+        size_t used = probe.equal.size() + (probe.hasRange() ? 1 : 0);
+        return used > 0 && used <= keyColumns().size();
+    }
+
+    void lookup(const IndexProbe& probe, std::vector<RowId>& out) const override {
+        std::string prefix = encoder.prefixOf(probe);
+        if (!probe.hasRange()) {
+            for (auto cursor = tree.seek(prefix); cursor.valid() && startsWith(cursor.key(), prefix); cursor.next()) {
+                out.push_back(cursor.row());
+            }
+            return;
+        }
+
+        // Every key part is self-delimiting, so comparing the leading bytes of a
+        // key against a bound compares the range column alone. One seek to the
+        // lower bound, then a walk that stops past the upper one.
+        std::string low = probe.lower.set ? encoder.boundOf(probe, prefix, probe.lower) : prefix;
+        std::string high = probe.upper.set ? encoder.boundOf(probe, prefix, probe.upper) : std::string();
+        auto cursor = tree.seek(low);
+        if (probe.lower.set && !probe.lower.inclusive) {
+            while (cursor.valid() && startsWith(cursor.key(), low)) cursor.next();
+        }
+        for (; cursor.valid() && startsWith(cursor.key(), prefix); cursor.next()) {
+            if (probe.upper.set) {
+                int order = cursor.key().compare(0, high.size(), high);
+                if (probe.upper.inclusive ? order > 0 : order >= 0) break;
+            }
+            out.push_back(cursor.row());
+        }
+    }
+
+    void build(const std::vector<Column>& data, const std::vector<bool>& deleted) override {
+        size_t threads = scanThreadsFor(deleted.size());
+        auto entries = liveEntries<std::string>(deleted, [&](RowId row) { return encoder.ofRow(data, row); }, threads);
+        parallelSort(entries, threads);
+        tree.bulkLoad(std::move(entries));
+    }
+
+    void remap(const std::vector<RowId>& newRowIds) override {
+        std::vector<std::pair<std::string, RowId>> entries;
+        entries.reserve(tree.size());
+        for (auto cursor = tree.begin(); cursor.valid(); cursor.next()) {
+            RowId newRow = newRowIds[cursor.row()];
+            if (newRow != INVALID_ROW) entries.emplace_back(cursor.key(), newRow);
+        }
+        tree.bulkLoad(std::move(entries));
+    }
+
+    bool firstRow(RowId& row) const override {
+        auto cursor = tree.begin();
+        if (cursor.valid()) row = cursor.row();
+        return cursor.valid();
+    }
+
+    bool lastRow(RowId& row) const override {
+        auto cursor = tree.last();
+        if (cursor.valid()) row = cursor.row();
+        return cursor.valid();
+    }
+
+    void visitKeyOrder(bool descending, const std::function<bool(RowId)>& visit) const override {
+        visitTree(tree, descending, visit);
+    }
+
+    bool keepsOrder() const override { return true; }
+
+    void keyOrder(std::vector<RowId>& out) const override {
+        out.reserve(out.size() + tree.size());
+        for (auto cursor = tree.begin(); cursor.valid(); cursor.next()) {
+            out.push_back(cursor.row());
+        }
+    }
+
+    bool buildFromOrder(const std::vector<Column>& data, const RowId* rows, size_t count) override {
+        size_t rowCount = data.empty() ? 0 : data[0].size();
+        std::vector<std::pair<std::string, RowId>> entries;
+        entries.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (rows[i] >= rowCount) return false;
+            entries.emplace_back(encoder.ofRow(data, rows[i]), rows[i]);
+            if (i > 0 && !(entries[i - 1] < entries[i])) return false;
+        }
+        tree.bulkLoad(std::move(entries));
+        return true;
+    }
+
+private:
+    CompositeKey encoder;
+    BPlusTree<std::string> tree;
+};
+
+// Multi-column hash index over encoded keys; answers equality on the whole key
+class CompositeHashIndex : public Index {
+public:
+    CompositeHashIndex(const std::vector<int>& columns, const std::vector<DataType>& types)
+        : Index(columns), encoder(columns, types) {}
+
+    std::string kind() const override { return "HASH"; }
+    size_t size() const override { return map.size(); }
+    void clear() override { map.clear(); }
+
+    void insert(const std::vector<Column>& data, RowId row) override {
+        map.insert(encoder.ofRow(data, row), row);
+    }
+
+    bool erase(const std::vector<Column>& data, RowId row) override {
+        return map.erase(encoder.ofRow(data, row), row);
+    }
+
+    bool supports(const IndexProbe& probe) const override {
+        return !probe.hasRange() && probe.equal.size() == keyColumns().size();
+    }
+
+    void lookup(const IndexProbe& probe, std::vector<RowId>& out) const override {
+        if (!supports(probe)) {
+            throw std::runtime_error("Lookup not supported by hash index.");
+        }
+        auto rows = map.find(encoder.prefixOf(probe));
+        out.insert(out.end(), rows.begin(), rows.end());
+    }
+
+    void build(const std::vector<Column>& data, const std::vector<bool>& deleted) override {
+        std::vector<std::string> keys(deleted.size());
+        for (size_t i = 0; i < deleted.size(); ++i) {
+            if (!deleted[i]) keys[i] = encoder.ofRow(data, static_cast<RowId>(i));
+        }
+        map.build(keys, deleted);
+    }
+
+    void remap(const std::vector<RowId>& newRowIds) override {
+        map.renumber(newRowIds, INVALID_ROW);
+    }
+
+private:
+    CompositeKey encoder;
+    FlatHashMultimap<std::string> map;
+};
+
+template <template <typename> class IndexType>
+std::unique_ptr<Index> makeSingleColumn(int column, DataType type) {
+    switch (type) {
+        case INT: return std::make_unique<IndexType<int32_t>>(std::vector<int>{column});
+        case REAL: return std::make_unique<IndexType<double>>(std::vector<int>{column});
+        default: return std::make_unique<IndexType<std::string>>(std::vector<int>{column});
+    }
+}
+
+} // namespace
+
+void IndexProbe::addRange(CompareOp op, const Value& value) {
+    if (op == CompareOp::EQ || op == CompareOp::NE) {
+        throw std::runtime_error("Operator not supported by ordered index.");
+    }
+    bool fromBelow = op == CompareOp::GT || op == CompareOp::GE;
+    bool inclusive = op == CompareOp::GE || op == CompareOp::LE;
+    RangeBound& bound = fromBelow ? lower : upper;
+    // Literals are converted to the column's type, so both values hold the same alternative
+    bool tighter = !bound.set || (fromBelow ? bound.value < value : value < bound.value) ||
+                   (value == bound.value && !inclusive);
+    if (tighter) bound = RangeBound{true, inclusive, value};
+}
+
+std::unique_ptr<Index> makeIndex(const std::string& kind, const std::vector<int>& keyColumns,
+                                 const std::vector<DataType>& keyTypes) {
+    if (keyColumns.empty() || keyColumns.size() != keyTypes.size()) {
+        throw std::runtime_error("An index needs one type per key column.");
+    }
+    bool single = keyColumns.size() == 1;
+    if (kind == "BTREE") {
+        if (single) return makeSingleColumn<OrderedIndex>(keyColumns[0], keyTypes[0]);
+        return std::make_unique<CompositeOrderedIndex>(keyColumns, keyTypes);
+    }
+    if (kind == "HASH") {
+        if (single) return makeSingleColumn<HashIndex>(keyColumns[0], keyTypes[0]);
+        return std::make_unique<CompositeHashIndex>(keyColumns, keyTypes);
+    }
+    throw std::runtime_error("Unknown index type '" + kind + "'. Expected BTREE or HASH.");
+}
+
+void appendEncodedKey(std::string& key, const Column& column, size_t row) {
+    appendKeyPart(key, column, row);
+}
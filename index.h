@@ -0,0 +1,108 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "column.h"
+#include "btree.h"
+
+// Marks a row that no longer exists when renumbering rows
+constexpr RowId INVALID_ROW = std::numeric_limits<RowId>::max();
+
+// Comparison operators an index can answer
+enum class CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE
+};
+
+// One end of a range on a key column, when set
+struct RangeBound {
+    bool set = false;
+    bool inclusive = false;
+    Value value;
+};
+
+// What an index lookup has to satisfy: equality on the first equal.size()
+// key columns and, on the key column right after them, a window between lower
+// and upper. On a single-column index this is either one equality or one
+// window, open at either end.
+struct IndexProbe {
+    std::vector<Value> equal;
+    RangeBound lower;
+    RangeBound upper;
+
+    bool hasRange() const { return lower.set || upper.set; }
+    // Narrows the window by "key op value", keeping the tighter bound when
+    // that end is already set; op has to be LT, LE, GT or GE
+    void addRange(CompareOp op, const Value& value);
+};
+
+// Secondary index over one or more columns, mapping keys to row ids. Keys are
+// read straight from the table's column arrays by row.
+class Index {
+public:
+    explicit Index(std::vector<int> keyColumns) : columns(std::move(keyColumns)) {}
+    virtual ~Index() = default;
+
+    // Column ordinals that make up the key, most significant first
+    const std::vector<int>& keyColumns() const { return columns; }
+
+    virtual std::string kind() const = 0;
+    virtual size_t size() const = 0;
+    virtual void clear() = 0;
+    // Adds or removes row's entry under the key it currently has in data
+    virtual void insert(const std::vector<Column>& data, RowId row) = 0;
+    virtual bool erase(const std::vector<Column>& data, RowId row) = 0;
+
+    // Whether lookup() can answer the probe without a scan
+    virtual bool supports(const IndexProbe& probe) const = 0;
+    // Appends the rows that satisfy the probe, in key order
+    virtual void lookup(const IndexProbe& probe, std::vector<RowId>& out) const = 0;
+    // Rebuilds from scratch out of every row not marked in deleted
+    virtual void build(const std::vector<Column>& data, const std::vector<bool>& deleted) = 0;
+    // Renumbers rows after the table is compacted. newRowIds[old] is the new id,
+    // or INVALID_ROW for a removed row; the mapping must preserve row order.
+    virtual void remap(const std::vector<RowId>& newRowIds) = 0;
+
+    // Ordered indexes find the row holding their smallest or largest key, which
+    // is also the smallest or largest value of their first key column. Return
+    // false when the index is empty or unordered.
+    virtual bool firstRow(RowId& /*row*/) const { return false; }
+    virtual bool lastRow(RowId& /*row*/) const { return false; }
+    // Ordered indexes hand their rows to visit in key order, or in reverse key
+    // order when descending, until visit returns false. Unordered ones never
+    // call it; check keepsOrder() first.
+    virtual void visitKeyOrder(bool /*descending*/, const std::function<bool(RowId)>& /*visit*/) const {}
+
+    // Ordered indexes can be saved as their rows in key order and rebuilt from
+    // that order without sorting; unordered ones are always rebuilt with build()
+    virtual bool keepsOrder() const { return false; }
+    virtual void keyOrder(std::vector<RowId>& /*out*/) const {}
+    // Rebuilds from every row of the table listed once in key order. Returns
+    // false, leaving the index unchanged, if rows are out of range or out of order.
+    virtual bool buildFromOrder(const std::vector<Column>& /*data*/, const RowId* /*rows*/, size_t /*count*/) { return false; }
+
+private:
+    std::vector<int> columns;
+};
+
+// Appends row's value in column to key in the encoding of composite index
+// keys, under which encoded keys compare bytewise like their values do,
+// column by column
+void appendEncodedKey(std::string& key, const Column& column, size_t row);
+
+// Creates an index of the given kind ("BTREE" or "HASH") over the key columns,
+// whose types are given in keyTypes. Throws for any other kind.
+//   BTREE answers equality on a key prefix plus a range on the next column.
+//   HASH answers equality on the whole key only.
+std::unique_ptr<Index> makeIndex(const std::string& kind, const std::vector<int>& keyColumns,
+                                 const std::vector<DataType>& keyTypes);
+
+#endif // INDEX_H
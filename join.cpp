@@ -0,0 +1,313 @@
+#include "join.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "hash_table.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Probe rows per task of an unpartitioned join
+constexpr size_t PROBE_CHUNK_ROWS = 16 * 1024;
+
+// A row with the hash of its join key
+struct HashedRow {
+    uint64_t hash;
+    RowId row;
+};
+
+// Bytes a build row takes in a chained table: its entry, its chain link and
+// about two bucket heads
+constexpr size_t TABLE_BYTES_PER_ROW = sizeof(HashedRow) + 3 * sizeof(uint32_t);
+
+// Start of each of threads equal slices of count items, and count at the end
+std::vector<size_t> sliceBounds(size_t count, size_t threads) {
+    std::vector<size_t> bounds;
+    for (size_t t = 0; t <= threads; ++t) bounds.push_back(count * t / threads);
+    return bounds;
+}
+
+template <typename KeyAt>
+std::vector<HashedRow> hashRows(const std::vector<RowId>& rows, KeyAt keyAt, size_t threads) {
+    std::vector<HashedRow> hashed(rows.size());
+    std::vector<size_t> bounds = sliceBounds(rows.size(), threads);
+    ThreadPool::shared().parallelFor(threads, [&](size_t t) {
+        for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) hashed[i] = {hashKey(keyAt(rows[i])), rows[i]};
+    }, threads);
+    return hashed;
+}
+
+// Scatters rows into 2^bits partitions by the top bits of their hashes, in
+// parallel slices. Every slice counts its rows per partition, then writes
+// them to its own consecutive range of each partition, so rows keep their
+// relative order. bounds receives where each partition starts, and the end.
+std::vector<HashedRow> partitionRows(const std::vector<HashedRow>& rows, unsigned bits, size_t threads,
+                                     std::vector<size_t>& bounds) {
+    size_t partitions = size_t(1) << bits;
+    unsigned shift = 64 - bits;
+    std::vector<size_t> slices = sliceBounds(rows.size(), threads);
+    std::vector<std::vector<size_t>> slots(threads, std::vector<size_t>(partitions, 0));
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(threads, [&](size_t t) {
+        for (size_t i = slices[t]; i < slices[t + 1]; ++i) ++slots[t][rows[i].hash >> shift];
+    }, threads);
+    bounds.assign(partitions + 1, 0);
+    size_t offset = 0;
+    for (size_t p = 0; p < partitions; ++p) {
+        bounds[p] = offset;
+        for (size_t t = 0; t < threads; ++t) {
+            size_t inSlice = slots[t][p];
+            slots[t][p] = offset;
+            offset += inSlice;
+        }
+    }
+    bounds[partitions] = offset;
+    std::vector<HashedRow> scattered(rows.size());
+    pool.parallelFor(threads, [&](size_t t) {
+        std::vector<size_t>& next = slots[t];
+        for (size_t i = slices[t]; i < slices[t + 1]; ++i) scattered[next[rows[i].hash >> shift]++] = rows[i];
+    }, threads);
+    return scattered;
+}
+
+// Hash table over build rows. Each bucket heads a chain of entries linked
+// through next (entry + 1, 0 ending the chain); entries are linked last to
+// first, so a chain lists its rows in build order.
+class ChainedTable {
+public:
+    ChainedTable(const HashedRow* buildRows, size_t count) : entries(buildRows), next(count) {
+        size_t buckets = 16;
+        while (buckets < count * 2) buckets *= 2;
+        mask = buckets - 1;
+        heads.assign(buckets, 0);
+        for (size_t i = count; i-- > 0;) {
+            size_t bucket = entries[i].hash & mask;
+            next[i] = heads[bucket];
+            heads[bucket] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    // Appends a pair for every build row whose key equals the probe row's
+    template <typename BuildKey, typename ProbeKey>
+    void probe(const HashedRow& probeRow, BuildKey buildKey, ProbeKey probeKey,
+               std::vector<RowId>& buildOut, std::vector<RowId>& probeOut) const {
+        for (uint32_t e = heads[probeRow.hash & mask]; e != 0; e = next[e - 1]) {
+            const HashedRow& candidate = entries[e - 1];
+            if (candidate.hash == probeRow.hash && buildKey(candidate.row) == probeKey(probeRow.row)) {
+                buildOut.push_back(candidate.row);
+                probeOut.push_back(probeRow.row);
+            }
+        }
+    }
+
+private:
+    const HashedRow* entries;
+    std::vector<uint32_t> heads;
+    std::vector<uint32_t> next;
+    size_t mask;
+};
+
+// Pairs found by one task of a join, firstRows[i] with secondRows[i]
+struct JoinPart {
+    std::vector<RowId> firstRows;
+    std::vector<RowId> secondRows;
+};
+
+// Concatenates the pairs of every part in task order
+JoinResult collectParts(const std::vector<JoinPart>& parts, bool firstIsLeft) {
+    JoinResult result;
+    size_t pairs = 0;
+    for (const JoinPart& part : parts) pairs += part.firstRows.size();
+    std::vector<RowId>& firstOut = firstIsLeft ? result.leftRows : result.rightRows;
+    std::vector<RowId>& secondOut = firstIsLeft ? result.rightRows : result.leftRows;
+    firstOut.reserve(pairs);
+    secondOut.reserve(pairs);
+    for (const JoinPart& part : parts) {
+        firstOut.insert(firstOut.end(), part.firstRows.begin(), part.firstRows.end());
+        secondOut.insert(secondOut.end(), part.secondRows.begin(), part.secondRows.end());
+    }
+    return result;
+}
+
+template <typename BuildKey, typename ProbeKey>
+JoinResult buildAndProbe(const JoinInput& build, BuildKey buildKey, const JoinInput& probe, ProbeKey probeKey,
+                         size_t threads, bool buildIsLeft) {
+    ThreadPool& pool = ThreadPool::shared();
+    std::vector<HashedRow> buildRows = hashRows(build.rows, buildKey, threads);
+    std::vector<HashedRow> probeRows = hashRows(probe.rows, probeKey, threads);
+
+    unsigned bits = 0;
+    while ((buildRows.size() * TABLE_BYTES_PER_ROW >> bits) > JOIN_CACHE_BYTES && (size_t(1) << bits) < MAX_JOIN_PARTITIONS) ++bits;
+
+    std::vector<JoinPart> parts;
+    if (bits == 0) {
+        // One shared table; the probe side is split into chunks that run in parallel
+        ChainedTable table(buildRows.data(), buildRows.size());
+        parts.resize((probeRows.size() + PROBE_CHUNK_ROWS - 1) / PROBE_CHUNK_ROWS);
+        pool.parallelFor(parts.size(), [&](size_t c) {
+            size_t end = std::min(probeRows.size(), (c + 1) * PROBE_CHUNK_ROWS);
+            for (size_t i = c * PROBE_CHUNK_ROWS; i < end; ++i) {
+                table.probe(probeRows[i], buildKey, probeKey, parts[c].firstRows, parts[c].secondRows);
+            }
+        }, threads);
+    } else {
+        std::vector<size_t> buildBounds, probeBounds;
+        buildRows = partitionRows(buildRows, bits, threads, buildBounds);
+        probeRows = partitionRows(probeRows, bits, threads, probeBounds);
+        parts.resize(size_t(1) << bits);
+        pool.parallelFor(parts.size(), [&](size_t p) {
+            if (buildBounds[p] == buildBounds[p + 1] || probeBounds[p] == probeBounds[p + 1]) return;
+            ChainedTable table(buildRows.data() + buildBounds[p], buildBounds[p + 1] - buildBounds[p]);
+            for (size_t i = probeBounds[p]; i < probeBounds[p + 1]; ++i) {
+                table.probe(probeRows[i], buildKey, probeKey, parts[p].firstRows, parts[p].secondRows);
+            }
+        }, threads);
+    }
+
+    JoinResult result = collectParts(parts, buildIsLeft);
+    result.method = "hash join building on '" + build.name + "' (" + std::to_string(build.rows.size()) + " rows)";
+    if (bits > 0) result.method += ", radix-partitioned into " + std::to_string(size_t(1) << bits) + " partitions";
+    if (threads > 1) result.method += ", on " + std::to_string(threads) + " threads";
+    return result;
+}
+
+// Reads a numeric key as REAL, so INT keys can meet REAL ones
+struct RealKey {
+    const Column& column;
+    double operator()(RowId row) const {
+        return column.type() == INT ? column.ints()[row] : column.reals()[row];
+    }
+};
+
+// Calls join with a reader of each side's key column, typed for the pair of
+// key types: int32_t or string values, or double when INT meets REAL
+template <typename Join>
+JoinResult onKeys(const JoinInput& left, const JoinInput& right, Join join) {
+    const Column& leftColumn = left.data[left.keyColumn];
+    const Column& rightColumn = right.data[right.keyColumn];
+    if (!joinable(leftColumn.type(), rightColumn.type())) {
+        throw std::runtime_error("Join keys of types that cannot be compared.");
+    }
+    if (leftColumn.type() == INT && rightColumn.type() == INT) {
+        const std::vector<int32_t>& leftValues = leftColumn.ints();
+        const std::vector<int32_t>& rightValues = rightColumn.ints();
+        return join([&](RowId row) { return leftValues[row]; }, [&](RowId row) { return rightValues[row]; });
+    }
+    if (leftColumn.type() == TEXT) {
+        const std::vector<std::string>& leftValues = leftColumn.texts();
+        const std::vector<std::string>& rightValues = rightColumn.texts();
+        return join([&](RowId row) -> const std::string& { return leftValues[row]; },
+                    [&](RowId row) -> const std::string& { return rightValues[row]; });
+    }
+    return join(RealKey{leftColumn}, RealKey{rightColumn});
+}
+
+// Index probe for the driver row's key in the type of the inner key column.
+// Returns false when no inner key can equal it: a REAL key that is not a
+// whole number in INT range, against an INT column.
+bool probeFor(const Column& driverKey, RowId row, DataType innerType, IndexProbe& probe) {
+    probe.equal.clear();
+    if (driverKey.type() == REAL && innerType == INT) {
+        double value = driverKey.reals()[row];
+        if (value != std::floor(value) || value < std::numeric_limits<int32_t>::min() ||
+            value > std::numeric_limits<int32_t>::max()) {
+            return false;
+        }
+        probe.equal.push_back(static_cast<int>(value));
+    } else if (driverKey.type() == INT && innerType == REAL) {
+        probe.equal.push_back(static_cast<double>(driverKey.ints()[row]));
+    } else {
+        probe.equal.push_back(driverKey.get(row));
+    }
+    return true;
+}
+
+} // namespace
+
+bool joinable(DataType left, DataType right) {
+    return (left == TEXT) == (right == TEXT);
+}
+
+JoinResult hashJoin(const JoinInput& left, const JoinInput& right, size_t threads) {
+    threads = std::max<size_t>(1, threads);
+    return onKeys(left, right, [&](auto leftKey, auto rightKey) {
+        if (left.rows.size() < right.rows.size()) {
+            return buildAndProbe(left, leftKey, right, rightKey, threads, true);
+        }
+        return buildAndProbe(right, rightKey, left, leftKey, threads, false);
+    });
+}
+
+JoinResult indexNestedLoopJoin(const JoinInput& driver, const IndexedInput& inner, bool driverIsLeft, size_t threads) {
+    const Column& driverKey = driver.data[driver.keyColumn];
+    DataType innerType = inner.data[inner.keyColumn].type();
+    if (!joinable(driverKey.type(), innerType)) {
+        throw std::runtime_error("Join keys of types that cannot be compared.");
+    }
+    threads = std::max<size_t>(1, threads);
+    bool filtered = !(inner.where.kind == Condition::AND && inner.where.children.empty());
+
+    std::vector<JoinPart> parts((driver.rows.size() + PROBE_CHUNK_ROWS - 1) / PROBE_CHUNK_ROWS);
+    std::vector<size_t> lookedUp(parts.size(), 0);
+    ThreadPool::shared().parallelFor(parts.size(), [&](size_t c) {
+        IndexProbe probe;
+        std::vector<RowId> matches;
+        size_t end = std::min(driver.rows.size(), (c + 1) * PROBE_CHUNK_ROWS);
+        for (size_t i = c * PROBE_CHUNK_ROWS; i < end; ++i) {
+            RowId row = driver.rows[i];
+            if (!probeFor(driverKey, row, innerType, probe)) continue;
+            matches.clear();
+            inner.index.lookup(probe, matches);
+            lookedUp[c] += matches.size();
+            // Composite indexes return their rows in key order
+            std::sort(matches.begin(), matches.end());
+            size_t kept = filtered ? inner.where.selectRows(inner.data, matches.data(), matches.size(), matches.data())
+                                   : matches.size();
+            parts[c].firstRows.insert(parts[c].firstRows.end(), kept, row);
+            parts[c].secondRows.insert(parts[c].secondRows.end(), matches.begin(), matches.begin() + kept);
+        }
+    }, threads);
+
+    JoinResult result = collectParts(parts, driverIsLeft);
+    for (size_t count : lookedUp) result.innerRowsExamined += count;
+    result.method = "index nested-loop join probing '" + inner.indexName + "' of '" + inner.name + "' for " +
+                    std::to_string(driver.rows.size()) + " row(s) of '" + driver.name + "'";
+    if (threads > 1 && parts.size() > 1) {
+        result.method += ", on " + std::to_string(std::min(threads, parts.size())) + " threads";
+    }
+    return result;
+}
+
+JoinResult mergeJoin(const JoinInput& left, const JoinInput& right) {
+    const std::vector<RowId>& leftRows = left.rows;
+    const std::vector<RowId>& rightRows = right.rows;
+    JoinResult result = onKeys(left, right, [&](auto leftKey, auto rightKey) {
+        JoinResult merged;
+        size_t l = 0, r = 0;
+        while (l < leftRows.size() && r < rightRows.size()) {
+            const auto& leftValue = leftKey(leftRows[l]);
+            const auto& rightValue = rightKey(rightRows[r]);
+            if (leftValue < rightValue) {
+                ++l;
+            } else if (rightValue < leftValue) {
+                ++r;
+            } else {
+                // Pair the run of equal keys on each side with the other's
+                size_t leftEnd = l + 1, rightEnd = r + 1;
+                while (leftEnd < leftRows.size() && leftKey(leftRows[leftEnd]) == leftValue) ++leftEnd;
+                while (rightEnd < rightRows.size() && rightKey(rightRows[rightEnd]) == rightValue) ++rightEnd;
+                for (size_t i = l; i < leftEnd; ++i) {
+                    merged.leftRows.insert(merged.leftRows.end(), rightEnd - r, leftRows[i]);
+                    merged.rightRows.insert(merged.rightRows.end(), rightRows.begin() + r, rightRows.begin() + rightEnd);
+                }
+                l = leftEnd;
+                r = rightEnd;
+            }
+        }
+        return merged;
+    });
+    result.method = "merge join of '" + left.name + "' (" + std::to_string(leftRows.size()) + " rows) and '" +
+                    right.name + "' (" + std::to_string(rightRows.size()) + " rows) in key order";
+    return result;
+}
@@ -0,0 +1,77 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "column.h"
+#include "index.h"
+#include "predicate.h"
+
+// A build side whose hash table takes up to this many bytes is joined as one
+// table. Larger ones are radix-partitioned on the key hash first, so that the
+// table of every partition stays in a core's L2 cache while it is probed.
+constexpr size_t JOIN_CACHE_BYTES = 512 * 1024;
+// Upper bound on the partitions of a radix join; more would thrash the TLB
+// while partitioning
+constexpr size_t MAX_JOIN_PARTITIONS = 4096;
+
+// One side of an equi-join: a table's columns, its join key column and the
+// rows that passed the side's own conditions, in row order (in key order for
+// a merge join)
+struct JoinInput {
+    const std::vector<Column>& data;
+    int keyColumn;
+    const std::vector<RowId>& rows;
+    std::string name; // How the side is referred to in the query, for display
+};
+
+// Pairs of matching rows, leftRows[i] joined with rightRows[i]
+struct JoinResult {
+    std::vector<RowId> leftRows;
+    std::vector<RowId> rightRows;
+    std::string method; // How the pairs were found, for display
+    size_t innerRowsExamined = 0; // Rows an index nested-loop join's lookups returned
+};
+
+// Inner side of an index nested-loop join: a table with an index whose first
+// key column is the join key
+struct IndexedInput {
+    const std::vector<Column>& data;
+    int keyColumn;
+    const Index& index;
+    std::string indexName;
+    const Condition& where; // The side's own conditions, checked on the rows lookups return
+    std::string name;
+};
+
+// Whether the key columns can be compared: INT and REAL with each other
+// (INT keys are compared as REAL then), TEXT only with TEXT
+bool joinable(DataType left, DataType right);
+
+// Build/probe hash join on left.key = right.key. The side with fewer rows is
+// built into a chained hash table of (hash, row) entries, and the other side
+// probes it in parallel, up to threads threads. Keys are hashed once; key
+// values are only compared when hashes are equal.
+//
+// When the table would exceed JOIN_CACHE_BYTES, both sides are first
+// scattered into 2^k partitions by the top bits of their hashes, in parallel
+// and preserving row order, and each partition is then built and probed on
+// its own thread. Pairs come out in probe order within each partition.
+JoinResult hashJoin(const JoinInput& left, const JoinInput& right, size_t threads);
+
+// Index nested-loop join: every driver row looks its key up in the inner
+// side's index, in O(log n) on a BTREE and O(1) on a HASH index, so the inner
+// table is never scanned. Chunks of driver rows probe in parallel, up to
+// threads threads. Pairs come out in driver row order, and the inner rows of
+// one driver row in row order.
+JoinResult indexNestedLoopJoin(const JoinInput& driver, const IndexedInput& inner, bool driverIsLeft, size_t threads);
+
+// Merge join of two inputs whose rows are listed in ascending key order, as
+// an ordered index on the key hands them out. Both lists are walked once and
+// every run of equal keys on one side is paired with the run on the other, so
+// nothing is hashed or sorted. Pairs come out in key order.
+JoinResult mergeJoin(const JoinInput& left, const JoinInput& right);
+
+#endif // JOIN_H
@@ -0,0 +1,50 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "thread_pool.h"
+
+// Sorts entries by less with up to threads threads of the shared pool: one
+// run per thread is sorted, then pairs of runs are merged in rounds until one
+// is left
+template <typename Entry, typename Less>
+void parallelSort(std::vector<Entry>& entries, size_t threads, Less less) {
+    if (threads <= 1) {
+        std::sort(entries.begin(), entries.end(), less);
+        return;
+    }
+    ThreadPool& pool = ThreadPool::shared();
+    std::vector<size_t> bounds;
+    for (size_t t = 0; t <= threads; ++t) bounds.push_back(entries.size() * t / threads);
+    pool.parallelFor(threads, [&](size_t t) {
+        std::sort(entries.begin() + bounds[t], entries.begin() + bounds[t + 1], less);
+    }, threads);
+
+    std::vector<Entry> merged(entries.size());
+    while (bounds.size() > 2) {
+        size_t runs = bounds.size() - 1;
+        pool.parallelFor((runs + 1) / 2, [&](size_t pair) {
+            auto first = entries.begin() + bounds[2 * pair];
+            auto middle = entries.begin() + bounds[std::min(2 * pair + 1, runs)];
+            auto last = entries.begin() + bounds[std::min(2 * pair + 2, runs)];
+            std::merge(std::make_move_iterator(first), std::make_move_iterator(middle), std::make_move_iterator(middle),
+                       std::make_move_iterator(last), merged.begin() + bounds[2 * pair], less);
+        }, threads);
+        entries.swap(merged);
+        std::vector<size_t> next;
+        for (size_t run = 0; run < runs; run += 2) next.push_back(bounds[run]);
+        next.push_back(bounds[runs]);
+        bounds.swap(next);
+    }
+}
+
+template <typename Entry>
+void parallelSort(std::vector<Entry>& entries, size_t threads) {
+    parallelSort(entries, threads, std::less<Entry>());
+}
+
+#endif // PARALLEL_SORT_H
@@ -0,0 +1,232 @@
+#include "predicate.h"
+#include "filter_kernels.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+bool compare(const T& value, CompareOp op, const T& literal) {
+    switch (op) {
+        case CompareOp::EQ: return value == literal;
+        case CompareOp::NE: return value != literal;
+        case CompareOp::LT: return value < literal;
+        case CompareOp::LE: return value <= literal;
+        case CompareOp::GT: return value > literal;
+        case CompareOp::GE: return value >= literal;
+    }
+    return false;
+}
+
+} // namespace
+
+bool Predicate::matches(const Column& data, size_t row) const {
+    switch (type) {
+        case INT: return compare(data.ints()[row], op, intLiteral);
+        case REAL: return compare(data.reals()[row], op, realLiteral);
+        default: return compare(data.texts()[row], op, textLiteral);
+    }
+}
+
+// INT and REAL go through the SIMD kernels; strings compare one by one
+size_t Predicate::selectRange(const Column& data, RowId first, size_t count, RowId* out) const {
+    switch (type) {
+        case INT: return filterRange(data.ints().data(), first, count, op, intLiteral, out);
+        case REAL: return filterRange(data.reals().data(), first, count, op, realLiteral, out);
+        default: return scalarFilterRange(data.texts().data(), first, count, op, textLiteral, out);
+    }
+}
+
+size_t Predicate::selectRows(const Column& data, const RowId* rows, size_t count, RowId* out) const {
+    switch (type) {
+        case INT: return filterRows(data.ints().data(), rows, count, op, intLiteral, out);
+        case REAL: return filterRows(data.reals().data(), rows, count, op, realLiteral, out);
+        default: return scalarFilterRows(data.texts().data(), rows, count, op, textLiteral, out);
+    }
+}
+
+bool Condition::matches(const std::vector<Column>& data, size_t row) const {
+    switch (kind) {
+        case COMPARE: return predicate.matches(data[predicate.column], row);
+        case AND:
+            for (const auto& child : children) {
+                if (!child.matches(data, row)) return false;
+            }
+            return true;
+        case OR:
+            for (const auto& child : children) {
+                if (child.matches(data, row)) return true;
+            }
+            return false;
+    }
+    return false;
+}
+
+size_t Condition::selectRange(const std::vector<Column>& data, RowId first, size_t count, RowId* out) const {
+    if (kind == COMPARE) return predicate.selectRange(data[predicate.column], first, count, out);
+    if (kind == AND && !children.empty()) {
+        size_t selected = children[0].selectRange(data, first, count, out);
+        for (size_t c = 1; c < children.size() && selected > 0; ++c) {
+            selected = children[c].selectRows(data, out, selected, out);
+        }
+        return selected;
+    }
+    for (size_t i = 0; i < count; ++i) out[i] = first + static_cast<RowId>(i);
+    return kind == AND ? count : selectRows(data, out, count, out);
+}
+
+size_t Condition::selectRows(const std::vector<Column>& data, const RowId* rows, size_t count, RowId* out) const {
+    switch (kind) {
+        case COMPARE: return predicate.selectRows(data[predicate.column], rows, count, out);
+        case AND: {
+            if (children.empty()) {
+                std::copy(rows, rows + count, out);
+                return count;
+            }
+            size_t selected = children[0].selectRows(data, rows, count, out);
+            for (size_t c = 1; c < children.size() && selected > 0; ++c) {
+                selected = children[c].selectRows(data, out, selected, out);
+            }
+            return selected;
+        }
+        case OR: {
+            // pending holds the rows no child has accepted yet, and from[i] is
+            // where pending[i] sits in the input. Accepted rows are flagged by
+            // position and written out in input order, which need not be row
+            // order: an ORDER BY read through an index filters rows in key order.
+            std::vector<RowId> pending(rows, rows + count);
+            std::vector<size_t> from(count);
+            for (size_t i = 0; i < count; ++i) from[i] = i;
+            std::vector<char> accepted(count, 0);
+            std::vector<RowId> hits(count);
+            for (size_t c = 0; c < children.size() && !pending.empty(); ++c) {
+                size_t found = children[c].selectRows(data, pending.data(), pending.size(), hits.data());
+                if (found == 0) continue;
+                size_t kept = 0;
+                for (size_t i = 0, h = 0; i < pending.size(); ++i) {
+                    if (h < found && hits[h] == pending[i]) {
+                        accepted[from[i]] = 1;
+                        ++h;
+                    } else {
+                        pending[kept] = pending[i];
+                        from[kept++] = from[i];
+                    }
+                }
+                pending.resize(kept);
+                from.resize(kept);
+            }
+            size_t selected = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (accepted[i]) out[selected++] = rows[i];
+            }
+            return selected;
+        }
+    }
+    return 0;
+}
+
+void Condition::optimize(const std::vector<Column>& data, const std::vector<RowId>& sample) {
+    if (kind == COMPARE) {
+        // Strings compare byte by byte and chase a pointer; numbers go through SIMD kernels
+        cost = predicate.type == TEXT ? 4.0 : 1.0;
+        if (sample.empty()) {
+            switch (predicate.op) {
+                case CompareOp::EQ: selectivity = 0.1; break;
+                case CompareOp::NE: selectivity = 0.9; break;
+                default: selectivity = 1.0 / 3; break;
+            }
+            return;
+        }
+    } else {
+        for (auto& child : children) child.optimize(data, sample);
+        // Stable, so children that rank the same keep the order they were written in
+        if (kind == AND) {
+            std::stable_sort(children.begin(), children.end(), [](const Condition& a, const Condition& b) {
+                return (1 - a.selectivity) * b.cost > (1 - b.selectivity) * a.cost;
+            });
+        } else {
+            std::stable_sort(children.begin(), children.end(), [](const Condition& a, const Condition& b) {
+                return a.selectivity * b.cost > b.selectivity * a.cost;
+            });
+        }
+        // Expected cost per row: a child only sees the rows the earlier ones passed on
+        cost = 0.0;
+        double reaching = 1.0;
+        for (const auto& child : children) {
+            cost += reaching * child.cost;
+            reaching *= kind == AND ? child.selectivity : 1 - child.selectivity;
+        }
+        if (sample.empty()) {
+            selectivity = kind == AND ? reaching : 1 - reaching;
+            return;
+        }
+    }
+    size_t hits = 0;
+    for (RowId row : sample) hits += matches(data, row);
+    selectivity = static_cast<double>(hits) / sample.size();
+}
+
+std::string Condition::toString() const {
+    if (kind == COMPARE) {
+        std::ostringstream text;
+        text << predicate.columnName << " " << compareOpToString(predicate.op) << " ";
+        switch (predicate.type) {
+            case INT: text << predicate.intLiteral; break;
+            case REAL: text << predicate.realLiteral; break;
+            default: text << "'" << predicate.textLiteral << "'"; break;
+        }
+        return text.str();
+    }
+    std::string text;
+    for (const auto& child : children) {
+        if (!text.empty()) text += kind == AND ? " AND " : " OR ";
+        bool nested = child.kind != COMPARE && child.children.size() > 1;
+        text += nested ? "(" + child.toString() + ")" : child.toString();
+    }
+    return text;
+}
+
+CompareOp parseCompareOp(const std::string& op) {
+    if (op == "=" || op == "==") return CompareOp::EQ;
+    if (op == "!=" || op == "<>") return CompareOp::NE;
+    if (op == "<") return CompareOp::LT;
+    if (op == "<=") return CompareOp::LE;
+    if (op == ">") return CompareOp::GT;
+    if (op == ">=") return CompareOp::GE;
+    throw std::runtime_error("Unsupported operator '" + op + "' in WHERE clause.");
+}
+
+std::string compareOpToString(CompareOp op) {
+    switch (op) {
+        case CompareOp::EQ: return "=";
+        case CompareOp::NE: return "!=";
+        case CompareOp::LT: return "<";
+        case CompareOp::LE: return "<=";
+        case CompareOp::GT: return ">";
+        case CompareOp::GE: return ">=";
+    }
+    return "?";
+}
+
+Value parseLiteral(DataType type, const std::string& text) {
+    switch (type) {
+        case INT: {
+            size_t consumed = 0;
+            int value = std::stoi(text, &consumed);
+            if (consumed != text.size()) throw std::invalid_argument("not an integer");
+            return value;
+        }
+        case REAL: {
+            size_t consumed = 0;
+            double value = std::stod(text, &consumed);
+            if (consumed != text.size()) throw std::invalid_argument("not a number");
+            return value;
+        }
+        default:
+            if (text.size() >= 2 && text.front() == '\'' && text.back() == '\'') {
+                return text.substr(1, text.size() - 2);
+            }
+            return text;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <string>
+#include <vector>
+#include "column.h"
+#include "index.h"
+
+// A WHERE condition compiled against a table schema: the column is resolved
+// to its ordinal and the literal is converted to the column's type once, so
+// evaluation never parses, lowercases or allocates per row.
+struct Predicate {
+    int column = -1;
+    std::string columnName;
+    DataType type = INT;
+    CompareOp op = CompareOp::EQ;
+    Value literal;
+
+    // Typed copies of the literal for the evaluation loops
+    int32_t intLiteral = 0;
+    double realLiteral = 0.0;
+    std::string textLiteral;
+
+    bool matches(const Column& data, size_t row) const;
+    // Write the rows that satisfy the predicate to out, in order, and return how
+    // many there are: of first .. first + count - 1, or of rows[0 .. count).
+    // out needs room for count rows and may be rows itself.
+    size_t selectRange(const Column& data, RowId first, size_t count, RowId* out) const;
+    size_t selectRows(const Column& data, const RowId* rows, size_t count, RowId* out) const;
+};
+
+// Rows sampled from a table to estimate how selective a condition is
+constexpr size_t SELECTIVITY_SAMPLE_ROWS = 1024;
+
+// A WHERE clause as a boolean tree of compiled comparisons. AND evaluates its
+// children in order, each one only on the rows the earlier ones kept; OR hands
+// each child only the rows the earlier ones rejected. Both therefore
+// short-circuit a batch at a time, and optimize() puts the children that are
+// cheap and discard the most rows first.
+struct Condition {
+    enum Kind {
+        COMPARE,
+        AND,
+        OR
+    };
+    Kind kind = AND; // An AND without children holds for every row
+    Predicate predicate;             // COMPARE only
+    std::vector<Condition> children; // AND and OR only
+
+    // Estimated fraction of rows that satisfy the condition, and relative cost
+    // of evaluating it on one row; filled in by optimize()
+    double selectivity = 1.0;
+    double cost = 0.0;
+
+    bool matches(const std::vector<Column>& data, size_t row) const;
+    // Same contract as the Predicate versions, over the table's columns
+    size_t selectRange(const std::vector<Column>& data, RowId first, size_t count, RowId* out) const;
+    size_t selectRows(const std::vector<Column>& data, const RowId* rows, size_t count, RowId* out) const;
+
+    // Estimates selectivity from the sample rows (or from the operators when
+    // there are none) and cost from the column types, then reorders children:
+    // AND by (1 - selectivity) / cost and OR by selectivity / cost, highest first
+    void optimize(const std::vector<Column>& data, const std::vector<RowId>& sample);
+    // SQL text of the condition, with children in evaluation order
+    std::string toString() const;
+};
+
+// Parses an SQL comparison operator, throwing on anything unsupported
+CompareOp parseCompareOp(const std::string& op);
+std::string compareOpToString(CompareOp op);
+
+// Converts literal text to a value of the given type; TEXT literals may be single-quoted
+Value parseLiteral(DataType type, const std::string& text);
+
+#endif // PREDICATE_H
@@ -0,0 +1,518 @@
+#include "snapshot.h"
+#include "thread_pool.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = {'H', 'E', 'X', 'A', 'S', 'N', 'A', 'P'};
+const size_t WRITE_BUFFER_SIZE = 4 << 20;
+// The header field that holds the table of contents offset sits after the magic, version and table count
+const off_t TOC_OFFSET_POSITION = sizeof(MAGIC) + 2 * sizeof(uint32_t);
+
+std::string systemError(const std::string& what, const std::string& filename) {
+    return what + " '" + filename + "': " + std::strerror(errno);
+}
+
+// Accumulates small fields in a large buffer and hands big blocks straight to write(2)
+class BlockWriter {
+public:
+    BlockWriter(int fd, const std::string& filename) : fd(fd), filename(filename) {
+        buffer.reserve(WRITE_BUFFER_SIZE);
+    }
+
+    void write(const void* data, size_t size) {
+        if (size >= WRITE_BUFFER_SIZE) {
+            flush();
+            writeAll(data, size);
+        } else {
+            if (buffer.size() + size > WRITE_BUFFER_SIZE) flush();
+            const char* bytes = static_cast<const char*>(data);
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+        offset += size;
+    }
+
+    template <typename T>
+    void put(T value) { write(&value, sizeof(value)); }
+
+    void putString(const std::string& str) {
+        put<uint32_t>(static_cast<uint32_t>(str.size()));
+        write(str.data(), str.size());
+    }
+
+    void pad() {
+        static const char zeros[8] = {0};
+        if (offset % 8) write(zeros, 8 - offset % 8);
+    }
+
+    void flush() {
+        if (!buffer.empty()) writeAll(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    uint64_t position() const { return offset; }
+
+private:
+    int fd;
+    std::string filename;
+    std::vector<char> buffer;
+    uint64_t offset = 0;
+
+    void writeAll(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(fd, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(systemError("Failed to write snapshot", filename));
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+};
+
+// Bounds-checked cursor over the mapped file
+class BlockReader {
+public:
+    BlockReader(const char* data, size_t size) : data(data), size(size) {}
+
+    const char* take(size_t bytes) {
+        if (bytes > size - pos) {
+            throw std::runtime_error("Snapshot file is truncated or corrupt.");
+        }
+        const char* at = data + pos;
+        pos += bytes;
+        return at;
+    }
+
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string getString() {
+        uint32_t length = get<uint32_t>();
+        return std::string(take(length), length);
+    }
+
+    void pad() {
+        if (pos % 8) take(8 - pos % 8);
+    }
+
+    void seek(uint64_t position) {
+        if (position > size) {
+            throw std::runtime_error("Snapshot file is truncated or corrupt.");
+        }
+        pos = static_cast<size_t>(position);
+    }
+
+    uint64_t position() const { return pos; }
+
+private:
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// Copies the live rows of a typed array, or returns the array itself when nothing is deleted
+template <typename T>
+const std::vector<T>& liveValues(const std::vector<T>& values, const Table& table, std::vector<T>& scratch) {
+    if (table.deletedCount == 0) return values;
+    scratch.clear();
+    scratch.reserve(table.liveRowCount());
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (!table.isDeleted(i)) scratch.push_back(values[i]);
+    }
+    return scratch;
+}
+
+void writeColumn(BlockWriter& out, const Table& table, const Column& column) {
+    switch (column.type()) {
+        case INT: {
+            std::vector<int32_t> scratch;
+            const auto& values = liveValues(column.ints(), table, scratch);
+            out.write(values.data(), values.size() * sizeof(int32_t));
+            break;
+        }
+        case REAL: {
+            std::vector<double> scratch;
+            const auto& values = liveValues(column.reals(), table, scratch);
+            out.write(values.data(), values.size() * sizeof(double));
+            break;
+        }
+        default: {
+            const auto& texts = column.texts();
+            std::vector<uint64_t> offsets;
+            offsets.reserve(table.liveRowCount() + 1);
+            uint64_t total = 0;
+            offsets.push_back(0);
+            for (size_t i = 0; i < texts.size(); ++i) {
+                if (table.isDeleted(i)) continue;
+                total += texts[i].size();
+                offsets.push_back(total);
+            }
+            out.write(offsets.data(), offsets.size() * sizeof(uint64_t));
+            for (size_t i = 0; i < texts.size(); ++i) {
+                if (!table.isDeleted(i)) out.write(texts[i].data(), texts[i].size());
+            }
+            break;
+        }
+    }
+    out.pad();
+}
+
+// Read-only mapping of a whole file, unmapped on scope exit
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Database file not found: " + filename);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error(systemError("Failed to stat", filename));
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0) {
+            void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error(systemError("Failed to map", filename));
+            }
+            ::madvise(mapped, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) ::munmap(const_cast<char*>(data), size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+Table& addTable(std::map<std::string, Table>& tables, const std::string& tableName) {
+    std::string key = tableName;
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    auto [it, inserted] = tables.emplace(key, Table(tableName));
+    if (!inserted) {
+        throw std::runtime_error("Failed to create table '" + tableName + "' during load.");
+    }
+    return it->second;
+}
+
+void readColumnDefinitions(BlockReader& in, Table& table) {
+    uint32_t columnCount = in.get<uint32_t>();
+    for (uint32_t c = 0; c < columnCount; ++c) {
+        std::string colName = in.getString();
+        uint32_t type = in.get<uint32_t>();
+        if (type > REAL) {
+            throw std::runtime_error("Invalid column type in snapshot for table '" + table.name + "'.");
+        }
+        table.addColumn(ColumnDefinition(colName, static_cast<DataType>(type)));
+    }
+}
+
+uint64_t readRowCount(BlockReader& in, size_t fileSize) {
+    uint64_t rowCount = in.get<uint64_t>();
+    if (rowCount > fileSize) {
+        throw std::runtime_error("Snapshot file is truncated or corrupt.");
+    }
+    return rowCount;
+}
+
+// Rows decoded by one load task; large columns are split so every core gets work
+const uint64_t LOAD_CHUNK_ROWS = 64 * 1024;
+
+template <typename T>
+void planFixedWidth(BlockReader& in, std::vector<T>& values, uint64_t rowCount, std::vector<std::function<void()>>& tasks) {
+    const char* block = in.take(rowCount * sizeof(T));
+    values.resize(rowCount);
+    for (uint64_t begin = 0; begin < rowCount; begin += LOAD_CHUNK_ROWS) {
+        uint64_t end = std::min(rowCount, begin + LOAD_CHUNK_ROWS);
+        tasks.push_back([block, &values, begin, end] {
+            std::memcpy(values.data() + begin, block + begin * sizeof(T), (end - begin) * sizeof(T));
+        });
+    }
+}
+
+// Bounds-checks a column block and queues the tasks that decode it
+void planColumn(BlockReader& in, Column& column, uint64_t rowCount, std::vector<std::function<void()>>& tasks) {
+    switch (column.type()) {
+        case INT:
+            planFixedWidth(in, column.ints(), rowCount, tasks);
+            break;
+        case REAL:
+            planFixedWidth(in, column.reals(), rowCount, tasks);
+            break;
+        default: {
+            const uint64_t* offsets = reinterpret_cast<const uint64_t*>(in.take((rowCount + 1) * sizeof(uint64_t)));
+            const char* bytes = in.take(offsets[rowCount]);
+            auto& texts = column.texts();
+            texts.resize(rowCount);
+            for (uint64_t begin = 0; begin < rowCount; begin += LOAD_CHUNK_ROWS) {
+                uint64_t end = std::min(rowCount, begin + LOAD_CHUNK_ROWS);
+                tasks.push_back([offsets, bytes, &texts, rowCount, begin, end] {
+                    for (uint64_t i = begin; i < end; ++i) {
+                        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > offsets[rowCount]) {
+                            throw std::runtime_error("Snapshot file has invalid string offsets.");
+                        }
+                        texts[i].assign(bytes + offsets[i], offsets[i + 1] - offsets[i]);
+                    }
+                });
+            }
+            break;
+        }
+    }
+}
+
+// An index recorded in the snapshot, built once its table is loaded
+struct PendingIndex {
+    Table* table;
+    std::string name;
+    std::unique_ptr<Index> index;
+    const RowId* order; // Saved rows in key order, or null to build from the columns
+};
+
+} // namespace
+
+bool Snapshot::isSnapshot(const std::string& filename) {
+    std::ifstream inFile(filename, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return inFile.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void Snapshot::save(const Database& db, const std::string& filename, const ProgressCallback& progress) {
+    // Write beside the target and rename, so a failed save never clobbers the last good snapshot
+    std::string tempName = filename + ".tmp";
+    int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(systemError("Failed to open file", tempName) + " for saving database.");
+    }
+
+    uint64_t totalCells = 0, cellsWritten = 0;
+    for (const auto& [tableName, table] : db.tables) {
+        totalCells += table.liveRowCount() * table.columns.size();
+    }
+
+    try {
+        BlockWriter out(fd, tempName);
+        out.write(MAGIC, sizeof(MAGIC));
+        out.put<uint32_t>(VERSION);
+        out.put<uint32_t>(static_cast<uint32_t>(db.tables.size()));
+        out.put<uint64_t>(0); // Table of contents offset, filled in below
+        out.putString(db.name);
+        out.pad();
+
+        // Table of contents: where each table header, column block and index block starts
+        struct TocEntry {
+            uint64_t table;
+            std::vector<uint64_t> columns;
+            std::vector<uint64_t> indexes; // 0 for an index saved by definition only
+        };
+        std::vector<TocEntry> toc;
+        for (const auto& [tableName, table] : db.tables) {
+            toc.push_back({out.position(), {}, {}});
+            out.putString(table.name);
+            out.put<uint32_t>(static_cast<uint32_t>(table.columns.size()));
+            for (const auto& col : table.columns) {
+                out.putString(col.name);
+                out.put<uint32_t>(static_cast<uint32_t>(col.dataType));
+            }
+            out.put<uint64_t>(table.liveRowCount());
+            out.put<uint32_t>(static_cast<uint32_t>(table.indexes.size()));
+            for (const auto& [indexName, index] : table.indexes) {
+                out.putString(indexName);
+                out.putString(index->kind());
+                out.put<uint32_t>(static_cast<uint32_t>(index->keyColumns().size()));
+                for (int column : index->keyColumns()) out.putString(table.columns[column].name);
+            }
+            out.pad();
+            for (const auto& column : table.columnData) {
+                toc.back().columns.push_back(out.position());
+                writeColumn(out, table, column);
+                cellsWritten += table.liveRowCount();
+                if (progress) progress(cellsWritten, totalCells);
+            }
+
+            // Ordered indexes are saved as their rows in key order, numbered as
+            // written (deleted rows are skipped), so loading needs no sort
+            std::vector<RowId> savedRowIds;
+            if (table.deletedCount > 0) {
+                savedRowIds.assign(table.rowCount(), INVALID_ROW);
+                RowId next = 0;
+                for (size_t i = 0; i < table.rowCount(); ++i) {
+                    if (!table.isDeleted(i)) savedRowIds[i] = next++;
+                }
+            }
+            for (const auto& [indexName, index] : table.indexes) {
+                if (!index->keepsOrder()) {
+                    toc.back().indexes.push_back(0);
+                    continue;
+                }
+                std::vector<RowId> order;
+                index->keyOrder(order);
+                if (!savedRowIds.empty()) {
+                    for (RowId& row : order) row = savedRowIds[row];
+                }
+                toc.back().indexes.push_back(out.position());
+                out.put<uint64_t>(order.size());
+                out.write(order.data(), order.size() * sizeof(RowId));
+                out.pad();
+            }
+        }
+
+        uint64_t tocOffset = out.position();
+        for (const auto& entry : toc) {
+            out.put<uint64_t>(entry.table);
+            out.put<uint64_t>(entry.columns.size());
+            for (uint64_t block : entry.columns) out.put<uint64_t>(block);
+            out.put<uint64_t>(entry.indexes.size());
+            for (uint64_t block : entry.indexes) out.put<uint64_t>(block);
+        }
+        out.flush();
+        if (::pwrite(fd, &tocOffset, sizeof(tocOffset), TOC_OFFSET_POSITION) != sizeof(tocOffset)) {
+            throw std::runtime_error(systemError("Failed to write snapshot", tempName));
+        }
+        if (::fsync(fd) != 0) {
+            throw std::runtime_error(systemError("Failed to sync", tempName));
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tempName.c_str());
+        throw;
+    }
+    ::close(fd);
+
+    if (::rename(tempName.c_str(), filename.c_str()) != 0) {
+        ::unlink(tempName.c_str());
+        throw std::runtime_error(systemError("Failed to replace", filename));
+    }
+}
+
+void Snapshot::load(const std::string& filename, std::string& dbName, std::map<std::string, Table>& tables) {
+    MappedFile file(filename);
+    BlockReader in(file.data, file.size);
+
+    if (std::memcmp(in.take(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("'" + filename + "' is not a HexaDB snapshot.");
+    }
+    uint32_t version = in.get<uint32_t>();
+    if (version != VERSION) {
+        throw std::runtime_error("Unsupported snapshot version " + std::to_string(version) + " in '" + filename + "'.");
+    }
+    uint32_t tableCount = in.get<uint32_t>();
+    uint64_t tocEntry = in.get<uint64_t>();
+    dbName = in.getString();
+
+    // Walk the table of contents and every table header up front. This is cheap,
+    // bounds-checks every block, and splits the decoding into independent tasks
+    struct TableLayout {
+        Table* table;
+        uint64_t rowCount;
+    };
+    std::vector<TableLayout> layouts;
+    std::vector<PendingIndex> pendingIndexes;
+    std::vector<std::function<void()>> tasks;
+    for (uint32_t t = 0; t < tableCount; ++t) {
+        in.seek(tocEntry);
+        uint64_t tableOffset = in.get<uint64_t>();
+        auto readOffsets = [&]() {
+            uint64_t count = in.get<uint64_t>();
+            if (count > file.size / sizeof(uint64_t)) {
+                throw std::runtime_error("Snapshot file is truncated or corrupt.");
+            }
+            std::vector<uint64_t> offsets(count);
+            for (auto& offset : offsets) offset = in.get<uint64_t>();
+            return offsets;
+        };
+        std::vector<uint64_t> blocks = readOffsets();
+        std::vector<uint64_t> indexBlocks = readOffsets();
+        tocEntry = in.position();
+
+        in.seek(tableOffset);
+        Table& table = addTable(tables, in.getString());
+        readColumnDefinitions(in, table);
+        uint64_t rowCount = readRowCount(in, file.size);
+        uint32_t indexCount = in.get<uint32_t>();
+        if (blocks.size() != table.columnData.size() || indexBlocks.size() != indexCount) {
+            throw std::runtime_error("Snapshot table of contents does not match table '" + table.name + "'.");
+        }
+        for (uint32_t i = 0; i < indexCount; ++i) {
+            std::string indexName = in.getString();
+            std::string kind = in.getString();
+            uint32_t keyCount = in.get<uint32_t>();
+            std::vector<int> keyColumns;
+            std::vector<DataType> keyTypes;
+            for (uint32_t k = 0; k < keyCount && k <= table.columns.size(); ++k) {
+                int column = table.getColumnIndex(in.getString());
+                if (column == -1) break;
+                keyColumns.push_back(column);
+                keyTypes.push_back(table.columns[column].dataType);
+            }
+            if (keyColumns.empty() || keyColumns.size() != keyCount) {
+                throw std::runtime_error("Invalid index '" + indexName + "' in snapshot for table '" + table.name + "'.");
+            }
+            pendingIndexes.push_back({&table, indexName, makeIndex(kind, keyColumns, keyTypes), nullptr});
+        }
+        // Saved key order of each ordered index, checked against the row count here
+        // and for order when it is adopted
+        for (uint32_t i = 0; i < indexBlocks.size(); ++i) {
+            if (indexBlocks[i] == 0) continue;
+            in.seek(indexBlocks[i]);
+            uint64_t count = in.get<uint64_t>();
+            if (count != rowCount) {
+                throw std::runtime_error("Snapshot index data does not match table '" + table.name + "'.");
+            }
+            PendingIndex& pending = pendingIndexes[pendingIndexes.size() - indexCount + i];
+            pending.order = reinterpret_cast<const RowId*>(in.take(count * sizeof(RowId)));
+        }
+
+        for (size_t c = 0; c < blocks.size(); ++c) {
+            in.seek(blocks[c]);
+            planColumn(in, table.columnData[c], rowCount, tasks);
+        }
+        layouts.push_back({&table, rowCount});
+    }
+
+    // Decode column chunks on every core, then build the indexes the same way
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(tasks.size(), [&](size_t i) { tasks[i](); });
+    for (auto& layout : layouts) {
+        layout.table->deleted.assign(layout.rowCount, false);
+    }
+    pool.parallelFor(pendingIndexes.size(), [&](size_t i) {
+        PendingIndex& pending = pendingIndexes[i];
+        const Table& table = *pending.table;
+        // Adopting the saved order is linear; a damaged order falls back to a full build
+        if (!pending.order || !pending.index->buildFromOrder(table.columnData, pending.order, table.rowCount())) {
+            pending.index->build(table.columnData, table.deleted);
+        }
+    });
+    for (auto& pending : pendingIndexes) {
+        pending.table->indexes[pending.name] = std::move(pending.index);
+    }
+
+    for (const auto& layout : layouts) {
+        std::cout << "Table '" << layout.table->name << "' loaded (" << layout.rowCount << " rows";
+        if (!layout.table->indexes.empty()) {
+            std::cout << ", " << layout.table->indexes.size() << " index(es)";
+        }
+        std::cout << ")." << std::endl;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "hexadb.h"
+
+// Versioned binary snapshot format written by SAVE DB and read by LOAD DB.
+//
+// Layout (all integers little-endian, every block padded to 8 bytes):
+//   header   "HEXASNAP", u32 version, u32 table count, u64 TOC offset, db name
+//   table    name, u32 column count, (name, u32 type) per column, u64 row count,
+//            u32 index count, (name, kind, u32 key count, key column names) per index
+//   columns  one block per column:
+//              INT  -> row count x int32
+//              REAL -> row count x double
+//              TEXT -> (row count + 1) x u64 offsets, then the string bytes
+//   indexes  one block per ordered (BTREE) index: u64 row count, then the
+//            rows as u32 in key order
+//   TOC      per table: u64 table offset, u64 column count, u64 offset per
+//            column block, u64 index count, u64 offset per index block (0 if none)
+// Strings are length-prefixed (u32). Only live rows are written, and index
+// blocks number rows as written.
+//
+// Numeric blocks are fixed width, so loading maps the file and copies each
+// block straight into the column arrays without parsing. The TOC lets the
+// loader find every block before reading any of them, so columns are decoded
+// in row chunks on the shared thread pool and indexes are built in parallel.
+// A B+tree index is rebuilt from its saved key order in linear time, without
+// sorting; hash indexes are rebuilt from the columns, which is also linear.
+class Snapshot {
+public:
+    static const uint32_t VERSION = 3;
+
+    // Reports progress as (cells written, total cells) after each column block
+    using ProgressCallback = std::function<void(uint64_t done, uint64_t total)>;
+
+    // True when the file starts with the snapshot magic
+    static bool isSnapshot(const std::string& filename);
+    static void save(const Database& db, const std::string& filename, const ProgressCallback& progress = nullptr);
+    // Reads every table into tables and the database name into dbName
+    static void load(const std::string& filename, std::string& dbName, std::map<std::string, Table>& tables);
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,243 @@
+#include "sort.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include "parallel_sort.h"
+#include "thread_pool.h"
+
+namespace {
+
+std::atomic<size_t> sortMemorySetting{DEFAULT_SORT_MEMORY};
+
+// Entries read back from a spilled run at a time
+constexpr size_t RUN_BUFFER_ENTRIES = 4096;
+
+uint64_t normalizeInt(int32_t value) {
+    return static_cast<uint32_t>(value) ^ 0x80000000u;
+}
+
+uint64_t normalizeReal(double value) {
+    if (value == 0) value = 0.0; // -0.0 sorts with 0.0
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    return bits & 0x8000000000000000ull ? ~bits : bits | 0x8000000000000000ull;
+}
+
+// Leading eight bytes of text, most significant first, zero-padded
+uint64_t normalizeText(const std::string& text) {
+    uint64_t prefix = 0;
+    size_t length = std::min<size_t>(text.size(), 8);
+    for (size_t i = 0; i < length; ++i) {
+        prefix |= static_cast<uint64_t>(static_cast<unsigned char>(text[i])) << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+// Packs width bits of normalized key per row into the remaining low bits of
+// the entries' keys, keeping only the most significant ones when they do not
+// all fit
+template <typename Normalize>
+void packKey(SortEntry* entries, size_t count, Normalize normalize, unsigned width, bool descending, unsigned& remaining) {
+    uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+    unsigned drop = width > remaining ? width - remaining : 0;
+    unsigned shift = remaining - (width - drop);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = normalize(entries[i].row);
+        if (descending) value = ~value & mask;
+        entries[i].key |= (value >> drop) << shift;
+    }
+    remaining = shift;
+}
+
+bool fitsExactly(const std::vector<Column>& data, const std::vector<SortKey>& keys) {
+    unsigned bits = 0;
+    for (const SortKey& key : keys) {
+        DataType type = data[key.column].type();
+        if (type == TEXT) return false;
+        bits += type == INT ? 32 : 64;
+    }
+    return bits <= 64;
+}
+
+// Stable LSD radix sort on the whole key, a byte per pass. Every thread
+// counts the bytes of its own chunk, and chunks scatter to consecutive slots
+// of each bucket, so a pass keeps the order of equal bytes.
+void radixSort(std::vector<SortEntry>& entries, size_t threads) {
+    size_t count = entries.size();
+    std::vector<SortEntry> buffer(count);
+    std::vector<size_t> bounds;
+    for (size_t t = 0; t <= threads; ++t) bounds.push_back(count * t / threads);
+    std::vector<std::array<size_t, 256>> slots(threads);
+    ThreadPool& pool = ThreadPool::shared();
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        pool.parallelFor(threads, [&](size_t t) {
+            slots[t].fill(0);
+            for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) ++slots[t][(entries[i].key >> shift) & 0xFF];
+        }, threads);
+        // A byte every key shares would leave the order as it is
+        bool shared = false;
+        for (size_t b = 0; b < 256 && !shared; ++b) {
+            size_t total = 0;
+            for (size_t t = 0; t < threads; ++t) total += slots[t][b];
+            shared = total == count;
+        }
+        if (shared) continue;
+        size_t offset = 0;
+        for (size_t b = 0; b < 256; ++b) {
+            for (size_t t = 0; t < threads; ++t) {
+                size_t inChunk = slots[t][b];
+                slots[t][b] = offset;
+                offset += inChunk;
+            }
+        }
+        pool.parallelFor(threads, [&](size_t t) {
+            std::array<size_t, 256>& next = slots[t];
+            for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+                buffer[next[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+            }
+        }, threads);
+        entries.swap(buffer);
+    }
+}
+
+} // namespace
+
+void setSortMemory(size_t bytes) {
+    sortMemorySetting = bytes;
+}
+
+size_t sortMemory() {
+    return sortMemorySetting;
+}
+
+RowSorter::RowSorter(const std::vector<Column>& tableData, std::vector<SortKey> sortKeys)
+    : data(tableData), keys(sortKeys), order(tableData, std::move(sortKeys)), exact(fitsExactly(tableData, keys)),
+      // Sorting needs as much scratch space again as the entries take
+      runCapacity(std::max(BATCH_SIZE, sortMemory() / (2 * sizeof(SortEntry)))) {}
+
+RowSorter::~RowSorter() {
+    for (std::FILE* file : spilled) std::fclose(file);
+}
+
+bool RowSorter::less(const SortEntry& left, const SortEntry& right) const {
+    if (left.key != right.key) return left.key < right.key;
+    return exact ? left.row < right.row : order(left.row, right.row);
+}
+
+void RowSorter::add(const Batch& batch) {
+    size_t base = entries.size();
+    entries.resize(base + batch.count);
+    SortEntry* out = entries.data() + base;
+    for (size_t i = 0; i < batch.count; ++i) out[i] = {0, batch.row(i)};
+    unsigned remaining = 64;
+    for (const SortKey& key : keys) {
+        if (remaining == 0) break;
+        const Column& column = data[key.column];
+        switch (column.type()) {
+            case INT: {
+                const std::vector<int32_t>& values = column.ints();
+                packKey(out, batch.count, [&](RowId row) { return normalizeInt(values[row]); }, 32, key.descending, remaining);
+                break;
+            }
+            case REAL: {
+                const std::vector<double>& values = column.reals();
+                packKey(out, batch.count, [&](RowId row) { return normalizeReal(values[row]); }, 64, key.descending, remaining);
+                break;
+            }
+            default: {
+                // Takes every bit left, so nothing is packed after a string
+                const std::vector<std::string>& values = column.texts();
+                packKey(out, batch.count, [&](RowId row) { return normalizeText(values[row]); }, 64, key.descending, remaining);
+                break;
+            }
+        }
+    }
+    if (entries.size() >= runCapacity) spillRun();
+}
+
+void RowSorter::sortEntries() {
+    size_t sortThreads = scanThreadsFor(entries.size());
+    threads = std::max(threads, sortThreads);
+    if (exact) {
+        radixSort(entries, sortThreads);
+    } else {
+        parallelSort(entries, sortThreads, [this](const SortEntry& left, const SortEntry& right) { return less(left, right); });
+    }
+}
+
+void RowSorter::spillRun() {
+    sortEntries();
+    std::FILE* file = std::tmpfile();
+    if (!file) {
+        throw std::runtime_error("Could not create a temporary file to spill a sorted run.");
+    }
+    spilled.push_back(file);
+    if (std::fwrite(entries.data(), sizeof(SortEntry), entries.size(), file) != entries.size() || std::fflush(file) != 0) {
+        throw std::runtime_error("Could not write a sorted run to a temporary file.");
+    }
+    std::rewind(file);
+    entries.clear();
+}
+
+void RowSorter::refill(Run& run) {
+    run.position = 0;
+    if (!run.file) {
+        run.buffer.clear();
+        return;
+    }
+    run.buffer.resize(RUN_BUFFER_ENTRIES);
+    size_t read = std::fread(run.buffer.data(), sizeof(SortEntry), RUN_BUFFER_ENTRIES, run.file);
+    if (read < RUN_BUFFER_ENTRIES && std::ferror(run.file)) {
+        throw std::runtime_error("Could not read a sorted run back from its temporary file.");
+    }
+    run.buffer.resize(read);
+}
+
+void RowSorter::finish() {
+    sortEntries();
+    if (spilled.empty()) return;
+
+    // Every spilled run is read through a small buffer; the rows still in
+    // memory form the last run
+    runs.resize(spilled.size() + 1);
+    for (size_t r = 0; r < spilled.size(); ++r) {
+        runs[r].file = spilled[r];
+        refill(runs[r]);
+    }
+    runs.back().buffer.swap(entries);
+    for (size_t r = 0; r < runs.size(); ++r) {
+        if (!runs[r].exhausted()) heap.push_back(r);
+    }
+    std::make_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) {
+        return less(runs[b].buffer[runs[b].position], runs[a].buffer[runs[a].position]);
+    });
+}
+
+bool RowSorter::next(Batch& batch) {
+    size_t count = 0;
+    if (runs.empty()) {
+        count = std::min(BATCH_SIZE, entries.size() - position);
+        for (size_t i = 0; i < count; ++i) batch.rows[i] = entries[position + i].row;
+        position += count;
+    } else {
+        auto after = [this](size_t a, size_t b) {
+            return less(runs[b].buffer[runs[b].position], runs[a].buffer[runs[a].position]);
+        };
+        while (count < BATCH_SIZE && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), after);
+            Run& run = runs[heap.back()];
+            batch.rows[count++] = run.buffer[run.position++].row;
+            if (run.exhausted()) refill(run);
+            if (run.exhausted()) {
+                heap.pop_back();
+            } else {
+                std::push_heap(heap.begin(), heap.end(), after);
+            }
+        }
+    }
+    batch.dense = false;
+    batch.count = count;
+    return count > 0;
+}
@@ -0,0 +1,82 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "column.h"
+#include "exec.h"
+
+// Memory a full sort may use for its working set of keys and row ids before
+// it spills sorted runs to temporary files (SET sort_memory = N, in MB)
+constexpr size_t DEFAULT_SORT_MEMORY = 256u << 20;
+void setSortMemory(size_t bytes);
+size_t sortMemory();
+
+// A row id with its sort keys normalized into one unsigned integer, such that
+// comparing the integers compares the rows. INT and REAL keys are mapped to
+// order-preserving bit patterns (inverted for DESC) and packed most
+// significant first; a TEXT key contributes the leading bytes of its string
+// and ends the packing. When everything fits, the key is exact and rows with
+// equal keys are ordered by row id. Otherwise it is a prefix: it orders rows
+// whose prefixes differ, and the rest are compared on their column values.
+struct SortEntry {
+    uint64_t key;
+    RowId row;
+};
+
+// Sorts the row ids of a table by a list of sort keys, in the same total
+// order as RowOrder. Rows are added in batches and normalized into
+// SortEntries on the way in. Exact keys are sorted with a parallel LSD radix
+// sort, one byte per pass, skipping bytes every key shares; prefix keys with
+// a parallel merge sort that compares column values only when prefixes tie.
+// Whenever the entries outgrow sortMemory(), they are sorted as a run and
+// written to a temporary file, and the runs are merged as rows are read out.
+class RowSorter {
+public:
+    RowSorter(const std::vector<Column>& data, std::vector<SortKey> keys);
+    ~RowSorter();
+    RowSorter(const RowSorter&) = delete;
+    RowSorter& operator=(const RowSorter&) = delete;
+
+    // Rows must arrive in increasing row order, as every scan produces them;
+    // the radix sort is stable and relies on it to break ties by row id
+    void add(const Batch& batch);
+    // Sorts the rows still in memory; next() hands out rows after this
+    void finish();
+    // Fills batch with the next rows in order; returns false once exhausted
+    bool next(Batch& batch);
+
+    bool exactKeys() const { return exact; }
+    size_t runsSpilled() const { return spilled.size(); }
+    size_t threadsUsed() const { return threads; }
+
+private:
+    // Buffered reader over one sorted run, on disk or the last one in memory
+    struct Run {
+        std::FILE* file = nullptr;
+        std::vector<SortEntry> buffer;
+        size_t position = 0;
+        bool exhausted() const { return position == buffer.size(); }
+    };
+
+    const std::vector<Column>& data;
+    std::vector<SortKey> keys;
+    RowOrder order;
+    bool exact;
+    size_t runCapacity;
+    size_t threads = 1;
+    std::vector<SortEntry> entries;
+    std::vector<std::FILE*> spilled;
+    std::vector<Run> runs;
+    std::vector<size_t> heap; // Runs by their current entry, smallest on top
+    size_t position = 0;
+
+    bool less(const SortEntry& left, const SortEntry& right) const;
+    void sortEntries();
+    void spillRun();
+    void refill(Run& run);
+};
+
+#endif // SORT_H
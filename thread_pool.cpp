@@ -0,0 +1,315 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// The pool worker running on this thread, if any, so a loop started inside a
+// task queues its helpers on that worker's own deque
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+// Parses a sysfs CPU list such as "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::istringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, ',')) {
+        size_t dash = part.find('-');
+        try {
+            int first = std::stoi(part.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            // The topology is only a hint; skip what cannot be read
+        }
+    }
+    return cpus;
+}
+
+// CPUs this process may run on, grouped by NUMA node: one group on single-node
+// machines, none when the platform does not tell
+std::vector<std::vector<int>> cpusByNode() {
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return nodes;
+    // Node numbers have gaps when nodes are offline
+    for (int node = 0; node < 256; ++node) {
+        std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!list) continue;
+        std::string text;
+        std::getline(list, text);
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(text)) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+        }
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+    if (nodes.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+        }
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+#endif
+    return nodes;
+}
+
+// One thread's share of a loop's indices. [begin, end) is packed into a single
+// word so the owner, taking from the front, and thieves, taking the back half,
+// each claim with one compare-and-swap.
+struct alignas(64) Share {
+    std::atomic<uint64_t> range{0};
+};
+
+uint64_t packRange(uint32_t begin, uint32_t end) { return static_cast<uint64_t>(end) << 32 | begin; }
+uint32_t rangeBegin(uint64_t range) { return static_cast<uint32_t>(range); }
+uint32_t rangeEnd(uint64_t range) { return static_cast<uint32_t>(range >> 32); }
+
+} // namespace
+
+// Shared by the caller and the helper tasks of one parallelFor. Helpers may run
+// after the call has returned, so the state lives on the heap; they then find
+// every share empty and never touch body.
+struct ThreadPool::Loop {
+    const std::function<void(size_t)>* body;
+    size_t total;
+    size_t seats; // The caller's seat is 0
+    std::unique_ptr<Share[]> shares;
+    std::atomic<size_t> nextSeat{1};
+    std::atomic<bool> started{false}; // Set by the first helper to run, or by the caller when done
+    std::atomic<size_t> finished{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    bool leftBehind = false; // A helper left with indices in its share; guarded by mutex
+    std::mutex mutex;
+    std::condition_variable done; // Signalled when the last index finishes or leftBehind is set
+
+    Loop(const std::function<void(size_t)>& loopBody, size_t count, size_t seatCount)
+        : body(&loopBody), total(count), seats(seatCount), shares(new Share[seatCount]) {
+        for (size_t s = 0; s < seats; ++s) {
+            shares[s].range = packRange(static_cast<uint32_t>(count * s / seats), static_cast<uint32_t>(count * (s + 1) / seats));
+        }
+    }
+
+    // Claims the next index for seat: the front of its own share, or else the
+    // back half of the largest share left, which becomes the seat's own
+    bool take(size_t seat, size_t& index) {
+        std::atomic<uint64_t>& own = shares[seat].range;
+        uint64_t range = own.load();
+        while (rangeBegin(range) < rangeEnd(range)) {
+            if (own.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)))) {
+                index = rangeBegin(range);
+                return true;
+            }
+        }
+        while (true) {
+            size_t victim = seats;
+            uint32_t most = 0;
+            for (size_t s = 0; s < seats; ++s) {
+                uint64_t r = shares[s].range.load();
+                if (rangeEnd(r) > rangeBegin(r) && rangeEnd(r) - rangeBegin(r) > most) {
+                    most = rangeEnd(r) - rangeBegin(r);
+                    victim = s;
+                }
+            }
+            if (victim == seats) return false;
+            uint64_t r = shares[victim].range.load();
+            uint32_t begin = rangeBegin(r);
+            uint32_t end = rangeEnd(r);
+            if (begin >= end) continue;
+            uint32_t middle = end - (end - begin + 1) / 2;
+            if (!shares[victim].range.compare_exchange_strong(r, packRange(begin, middle))) continue;
+            // Nobody else writes an empty share, and a thief holding an old value
+            // of it cannot match the new one since indices are never handed out twice
+            own.store(packRange(middle + 1, end));
+            index = middle;
+            return true;
+        }
+    }
+};
+
+ThreadPool::ThreadPool(size_t threads) {
+    std::vector<std::vector<int>> topology = cpusByNode();
+    if (threads == 0) {
+        for (const auto& cpus : topology) threads += cpus.size();
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Pinning only pays off when there is remote memory to stay away from
+    nodes = topology.size() > 1 ? topology.size() : 1;
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->node = i % nodes; // Round-robin, so even a small pool uses every node
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        for (bool remote : {false, true}) {
+            for (size_t step = 1; step < threads; ++step) {
+                size_t other = (i + step) % threads;
+                if ((workers[other]->node != workers[i]->node) == remote) workers[i]->victims.push_back(other);
+            }
+        }
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+#ifdef __linux__
+        if (nodes > 1) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (int cpu : topology[workers[i]->node]) CPU_SET(cpu, &cpus);
+            pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpus), &cpus);
+        }
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    size_t target = currentPool == this ? currentWorker : nextWorker.fetch_add(1) % workers.size();
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne(size_t self) {
+    std::function<void()> task;
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t i = 0; !task && i < workers[self]->victims.size(); ++i) {
+        Worker& victim = *workers[workers[self]->victims[i]];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) return false;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        --queued;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    while (true) {
+        if (runOne(self)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return; // Stopping and drained
+        }
+    }
+}
+
+void ThreadPool::work(const std::shared_ptr<Loop>& loop, size_t seat, bool helper) {
+    size_t index;
+    while (loop->take(seat, index)) {
+        if (!loop->failed) {
+            try {
+                (*loop->body)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (!loop->error) loop->error = std::current_exception();
+                loop->failed = true;
+            }
+        }
+        if (loop->finished.fetch_add(1) + 1 == loop->total) {
+            std::lock_guard<std::mutex> lock(loop->mutex);
+            loop->done.notify_all();
+        }
+        // Make room for a loop still waiting for its first helper. What is left
+        // of this seat's share stays there for the threads that stay; the caller
+        // may already be waiting, so it is woken to take it.
+        if (helper && starvingLoops > 0) {
+            uint64_t rest = loop->shares[seat].range.load();
+            if (rangeBegin(rest) < rangeEnd(rest)) {
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                loop->leftBehind = true;
+                loop->done.notify_all();
+            }
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads) {
+    if (count == 0) return;
+    size_t helpers = std::min(workers.size(), count - 1);
+    if (maxThreads > 0) helpers = std::min(helpers, maxThreads - 1);
+    // Shares keep their bounds in 32 bits
+    if (helpers == 0 || count > std::numeric_limits<uint32_t>::max()) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    auto loop = std::make_shared<Loop>(body, count, helpers + 1);
+    ++starvingLoops;
+    for (size_t h = 0; h < helpers; ++h) {
+        push([this, loop] {
+            if (!loop->started.exchange(true)) --starvingLoops;
+            work(loop, loop->nextSeat.fetch_add(1), true);
+        });
+    }
+
+    work(loop, 0, false);
+    if (!loop->started.exchange(true)) --starvingLoops;
+    // Once the caller finds nothing left to take, the unfinished indices are in
+    // the hands of helpers: each runs the rest of its share, or wakes the caller
+    // to take it over when it leaves early
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    while (true) {
+        loop->done.wait(lock, [&] { return loop->finished == loop->total || loop->leftBehind; });
+        if (loop->finished == loop->total) break;
+        loop->leftBehind = false;
+        lock.unlock();
+        work(loop, 0, false);
+        lock.lock();
+    }
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
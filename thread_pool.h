@@ -0,0 +1,82 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Morsel-driven scheduler shared by every parallel operator: scans, index
+// builds, snapshot loads and aggregations.
+//
+// Each worker owns a deque of tasks. A worker runs its own tasks newest first
+// and, once it runs out, steals the oldest task of another worker, trying the
+// workers on its own NUMA node before remote ones. On machines with more than
+// one NUMA node every worker is pinned to the CPUs of one node, with workers
+// spread round-robin over the nodes.
+//
+// parallelFor() splits its index range into one contiguous share per thread
+// working on the loop. A thread takes indices from the front of its own share
+// and, when that is empty, steals the back half of the largest remaining
+// share, so one slow morsel or a skewed partition never leaves the other
+// threads idle. Loops may nest: a loop started inside a task queues its
+// helpers on that worker's deque, where idle workers find them.
+class ThreadPool {
+public:
+    // threads == 0 uses one worker per CPU this process may run on
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+    // NUMA nodes the workers are spread over; 1 when they are not pinned
+    size_t nodeCount() const { return nodes; }
+
+    // Calls body(i) for every i in [0, count) and returns once all calls have
+    // finished. The first exception thrown by body is rethrown here; indices not
+    // yet started when it was thrown are skipped. maxThreads caps the threads
+    // working on the loop, the caller included; 0 allows every worker.
+    //
+    // While another loop is waiting for its first helper, threads helping this
+    // one leave it after their current index, so concurrent loops share the
+    // workers instead of queueing behind each other. A helper leaving indices
+    // in its share wakes the caller, which stays until every index has run.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads = 0);
+
+    // Process-wide pool, started on first use
+    static ThreadPool& shared();
+
+private:
+    struct alignas(64) Worker {
+        std::thread thread;
+        size_t node = 0;
+        std::vector<size_t> victims; // Other workers, same node first
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    struct Loop;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t nodes = 1;
+    std::atomic<size_t> nextWorker{0};    // Round-robin target for submissions from outside the pool
+    std::atomic<size_t> starvingLoops{0}; // Loops whose helpers have not started yet
+
+    // Idle workers sleep until queued becomes non-zero
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    size_t queued = 0;
+    bool stopping = false;
+
+    void workerLoop(size_t self);
+    void push(std::function<void()> task);
+    bool runOne(size_t self);
+    void work(const std::shared_ptr<Loop>& loop, size_t seat, bool helper);
+};
+
+#endif // THREAD_POOL_H
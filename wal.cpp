@@ -0,0 +1,230 @@
+#include "wal.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+const size_t HEADER_SIZE = sizeof(uint32_t) * 2 + sizeof(uint8_t);
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, const Options& options)
+    : logPath(path), options(options) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open write-ahead log '" + path + "': " + std::strerror(errno));
+    }
+    flusher = std::thread(&WriteAheadLog::flushLoop, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+    ::close(fd);
+}
+
+void WriteAheadLog::encode(std::vector<char>& out, RecordType type, const std::string& payload) {
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    char typeByte = static_cast<char>(type);
+    uint32_t crc = crc32(payload.data(), payload.size(), crc32(&typeByte, 1));
+    size_t start = out.size();
+    out.resize(start + HEADER_SIZE + payload.size());
+    std::memcpy(&out[start], &length, sizeof(length));
+    std::memcpy(&out[start + 4], &crc, sizeof(crc));
+    out[start + 8] = typeByte;
+    std::memcpy(&out[start + HEADER_SIZE], payload.data(), payload.size());
+}
+
+void WriteAheadLog::enqueue(RecordType type, const std::string& payload) {
+    bool wakeFlusher;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!flushError.empty()) {
+            throw std::runtime_error(flushError);
+        }
+        encode(pending, type, payload);
+        ++pendingRecords;
+        ++appendedRecords;
+        // The first record starts the commit window; a full batch ends it early
+        wakeFlusher = pendingRecords == 1 || pendingRecords >= options.groupCommitRecords;
+    }
+    if (wakeFlusher) wake.notify_one();
+}
+
+void WriteAheadLog::append(const std::string& statement) {
+    enqueue(STATEMENT, statement);
+}
+
+void WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = appendedRecords;
+    syncRequested = true;
+    wake.notify_one();
+    synced.wait(lock, [&] { return durableRecords >= target || !flushError.empty(); });
+    if (!flushError.empty()) {
+        throw std::runtime_error(flushError);
+    }
+}
+
+void WriteAheadLog::reset(const std::string& baseSnapshot) {
+    rebase(baseSnapshot, mark());
+}
+
+uint64_t WriteAheadLog::mark() {
+    sync();
+    std::lock_guard<std::mutex> io(ioMutex);
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end < 0) {
+        throw std::runtime_error("Failed to read write-ahead log position '" + logPath + "': " + std::strerror(errno));
+    }
+    return static_cast<uint64_t>(end);
+}
+
+void WriteAheadLog::rebase(const std::string& baseSnapshot, uint64_t keepFrom) {
+    sync();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> io(ioMutex);
+
+    // Records after keepFrom are not covered by the new base and must be carried over
+    std::vector<char> contents;
+    encode(contents, BASE, baseSnapshot);
+    std::ifstream oldLog(logPath, std::ios::binary);
+    oldLog.seekg(static_cast<std::streamoff>(keepFrom));
+    contents.insert(contents.end(), std::istreambuf_iterator<char>(oldLog), std::istreambuf_iterator<char>());
+
+    // Build the new log beside the old one and swap it in, so a crash leaves one of them intact
+    std::string tempPath = logPath + ".tmp";
+    int tempFd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (tempFd < 0) {
+        throw std::runtime_error("Failed to create write-ahead log '" + tempPath + "': " + std::strerror(errno));
+    }
+    std::swap(fd, tempFd);
+    try {
+        writeAll(contents.data(), contents.size());
+        if (::fdatasync(fd) != 0 || ::rename(tempPath.c_str(), logPath.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace write-ahead log '" + logPath + "': " + std::strerror(errno));
+        }
+    } catch (...) {
+        std::swap(fd, tempFd);
+        ::close(tempFd);
+        ::unlink(tempPath.c_str());
+        throw;
+    }
+    ::close(tempFd);
+}
+
+void WriteAheadLog::writeAndSync(const std::vector<char>& data) {
+    std::lock_guard<std::mutex> io(ioMutex);
+    writeAll(data.data(), data.size());
+    if (::fdatasync(fd) != 0) {
+        throw std::runtime_error("Failed to sync write-ahead log '" + logPath + "': " + std::strerror(errno));
+    }
+}
+
+void WriteAheadLog::writeAll(const char* bytes, size_t remaining) {
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to write write-ahead log '" + logPath + "': " + std::strerror(errno));
+        }
+        bytes += written;
+        remaining -= static_cast<size_t>(written);
+    }
+}
+
+void WriteAheadLog::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || syncRequested || pendingRecords > 0; });
+        // Give other records the rest of the commit window to join this batch
+        if (pendingRecords > 0 && pendingRecords < options.groupCommitRecords && !stopping && !syncRequested) {
+            wake.wait_for(lock, std::chrono::milliseconds(options.groupCommitMs), [&] {
+                return stopping || syncRequested || pendingRecords >= options.groupCommitRecords;
+            });
+        }
+        syncRequested = false;
+        if (pendingRecords > 0) {
+            std::vector<char> batch;
+            batch.swap(pending);
+            uint64_t batchEnd = appendedRecords;
+            pendingRecords = 0;
+            lock.unlock();
+            std::string error;
+            try {
+                writeAndSync(batch);
+            } catch (const std::runtime_error& e) {
+                error = e.what();
+            }
+            lock.lock();
+            if (error.empty()) durableRecords = batchEnd;
+            else flushError = error;
+        }
+        synced.notify_all();
+        if (stopping && pendingRecords == 0) break;
+    }
+}
+
+uint64_t WriteAheadLog::replay(const std::string& path,
+                               const std::function<void(const std::string&)>& onBase,
+                               const std::function<void(const std::string&)>& onStatement) {
+    std::ifstream inFile(path, std::ios::binary | std::ios::ate);
+    if (!inFile.is_open()) {
+        return 0;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(inFile.tellg());
+    inFile.seekg(0);
+    uint64_t validBytes = 0;
+    std::string payload;
+    while (inFile) {
+        char header[HEADER_SIZE];
+        if (!inFile.read(header, HEADER_SIZE)) break;
+        uint32_t length, crc;
+        std::memcpy(&length, header, sizeof(length));
+        std::memcpy(&crc, header + 4, sizeof(crc));
+        char typeByte = header[8];
+        if (length > fileSize - validBytes - HEADER_SIZE) break;
+
+        payload.resize(length);
+        if (length > 0 && !inFile.read(&payload[0], length)) break;
+        if (crc32(payload.data(), payload.size(), crc32(&typeByte, 1)) != crc) break;
+
+        if (typeByte == BASE) {
+            onBase(payload);
+        } else if (typeByte == STATEMENT) {
+            onStatement(payload);
+        } else {
+            break;
+        }
+        validBytes += HEADER_SIZE + length;
+    }
+    return validBytes;
+}
@@ -0,0 +1,84 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only redo log of the statements that changed the database since the
+// last snapshot. Each record is
+//   u32 payload length | u32 crc32 of type + payload | u8 type | payload
+// A BASE record names the snapshot the log applies on top of and is always
+// the first record; STATEMENT records hold one SQL statement each.
+//
+// Appends are buffered and made durable by a background flusher using group
+// commit: one write + fdatasync covers every record that arrived within the
+// commit window, or as soon as enough records are pending.
+class WriteAheadLog {
+public:
+    struct Options {
+        unsigned groupCommitMs = 10;       // Longest a record waits before it is synced
+        size_t groupCommitRecords = 64;    // Pending records that force an immediate sync
+    };
+
+    enum RecordType : uint8_t {
+        BASE = 1,
+        STATEMENT = 2
+    };
+
+    WriteAheadLog(const std::string& path, const Options& options);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    const std::string& path() const { return logPath; }
+
+    // Queues a statement; it becomes durable at the next group commit
+    void append(const std::string& statement);
+    // Blocks until every queued record is on disk
+    void sync();
+    // Discards all records and starts a new log on top of baseSnapshot
+    void reset(const std::string& baseSnapshot);
+    // Syncs and returns the current end of the log, for a later rebase()
+    uint64_t mark();
+    // Starts a new log on top of baseSnapshot that keeps the records written
+    // after position keepFrom; used when a snapshot captured the log at that point
+    void rebase(const std::string& baseSnapshot, uint64_t keepFrom);
+
+    // Reads a log, calling onBase for the BASE record and onStatement for each
+    // STATEMENT that follows. Stops at the first torn or corrupt record and
+    // returns the length of the intact prefix.
+    static uint64_t replay(const std::string& path,
+                           const std::function<void(const std::string&)>& onBase,
+                           const std::function<void(const std::string&)>& onStatement);
+
+private:
+    std::string logPath;
+    Options options;
+    int fd = -1;
+
+    std::mutex mutex;                  // Guards the pending batch and counters
+    std::mutex ioMutex;                // Serializes writes to fd
+    std::condition_variable wake;      // Signals the flusher
+    std::condition_variable synced;    // Signals sync() waiters
+    std::vector<char> pending;
+    size_t pendingRecords = 0;
+    uint64_t appendedRecords = 0;
+    uint64_t durableRecords = 0;
+    bool syncRequested = false;
+    bool stopping = false;
+    std::string flushError;            // Set by the flusher, reported to the next caller
+    std::thread flusher;
+
+    static void encode(std::vector<char>& out, RecordType type, const std::string& payload);
+    void enqueue(RecordType type, const std::string& payload);
+    void flushLoop();
+    void writeAndSync(const std::vector<char>& data);
+    void writeAll(const char* bytes, size_t size);
+};
+
+#endif // WAL_H